@@ -7,255 +7,4197 @@ This code is designed to allow for the generation of arbitrary audible tones of
 a single frequency at a given volume for a specified duration (with ~microsecond
 accuracy). Supports frequencies above ~7.5 Hz. Uses ultrasonic changes to the
 PWM duty cycle to create the illusion of volume. The ultrasonic PWM operates
-at 62.5kHz (on a stock clock-frequency RP2040). The PWM update functions are
-passed to a hardware timer with ~microsecond accuracy.
+at 62.5kHz (on a stock clock-frequency RP2040) with 1000 volume steps by
+default; set_carrier() trades one against the other for any system clock. The
+PWM update functions are passed to a hardware timer with ~microsecond accuracy.
 
 Handles both single-ended and differential inputs for audio (declared at 
 initialization). If using differential inputs, you must use pins on the same
-PWM Slice (e.g. PWM_1A and PWM_1B).
+PWM Slice (e.g. PWM_1A and PWM_1B), or neighbouring pins with TONE_ENGINE_PIO.
+
+Five playback engines are available (selected at initialization):
+  - TONE_ENGINE_TIMER: a repeating alarm flips the PWM level every
+    half period. Edges are accurate to ~1 us but the CPU takes an interrupt on
+    every edge (40k interrupts per second for a 20 kHz tone).
+  - TONE_ENGINE_DMA: a pair of DMA channels, paced by the PWM slice's wrap
+    DREQ, copy precomputed CC register words into the slice so the CPU does no
+    work per half-cycle. Half periods are rounded to a whole number of PWM
+    carrier periods (16 us on a stock clock), so this engine is best suited to
+    lower frequencies. The only interrupt is a single alarm at the end of the
+    note. A queued note's words go into a second buffer that the DMA picks
+    up on the next half period boundary, so its level and length switch
+    together there.
+  - TONE_ENGINE_NCO: a numerically controlled oscillator. A 32-bit phase
+    accumulator, stepped once per PWM carrier period, picks the CC word for
+    each carrier period; blocks of TONE_STREAM_BLOCK words are rendered ahead
+    and fed to the slice by a ping-pong pair of DMA channels paced by the wrap
+    DREQ. Edges still land on carrier periods, but the average frequency is
+    exact to well under 1 Hz across the audio band (no ~200 Hz error at 20
+    kHz) and the CPU only takes one interrupt per block (~490 per second by
+    default) whatever the frequency. It can also play sine, triangle or
+    custom wavetables (set_waveform()) by modulating the duty cycle on every
+    carrier period instead of flipping between two levels.
+  - TONE_ENGINE_MIXER: the NCO engine with up to TONE_MAX_VOICES voices on one
+    output. Every tone() call starts a new voice (and returns its handle) and
+    voices are summed in fixed point once per carrier period, so chords and
+    overlapping alerts can share a slice. Each mixer instance takes its
+    voices from a static pool of TONE_MIXERS banks.
+  - TONE_ENGINE_PIO: a PIO state machine generates both the carrier and the
+    half period toggle, so no PWM slice is used and the pins only need to be
+    next to each other (e.g. GPIO 1 and 2, which are on different slices).
+    One DMA channel loops the half period length and level words into the
+    state machine's TX FIFO; like the DMA engine the only interrupt is the
+    end of the note, and up to 8 outputs (two PIO blocks of four state
+    machines) can run alongside the PWM-based ones.
+
+All instances on a core share one hardware alarm: their edges and note ends
+are kept in a deadline-sorted list per core (RP2040_Tone_Scheduler), so
+driving many speakers doesn't use up the RP2040's four alarms.
+
+Notes can also be queued with enqueue_tone()/enqueue_rest(). The engine loads
+the next queued note from its own interrupt at the end of the current one, with
+no gap or PWM re-initialisation in between, so whole melodies can be played
+without blocking.
+
+tone_fixed()/tone_midi() (and their enqueue_ versions) take integer units and
+use no floating point at all, which matters on the FPU-less Cortex-M0+ where
+the float/double math in tone() runs through soft-float routines.
+
+Any engine but the mixer can be moved onto core 1 by OR-ing TONE_ON_CORE1 into
+the engine argument and starting RP2040_Tone_Core1. Calls made on core 0 then only post a
+small command to a shared ring and wake core 1, which owns every alarm, DMA and
+PWM interrupt for those instances.
+
+The buffered engines can also play recorded audio with play_pcm(): 8-bit
+unsigned or 16-bit signed samples are read in place (e.g. straight from flash
+through XIP), scaled to CC words a block at a time and paced out by a DMA
+timer, so the CPU only steps in once per block.
+
+Live audio can be streamed in with begin_stream()/write(): samples are turned
+into CC words as they're written into a lock-free ring, and the DMA pair reads
+whole blocks straight out of the ring, so producers on the other core or in an
+interrupt never wait and the DMA interrupt only moves pointers.
+
+Interrupt handlers can start and stop notes with tone_from_isr() and friends.
+They are wait-free: the request is copied into a lock-free ring and picked up
+by a lowest-priority software interrupt (or core 1) on the engine's core, so
+the calling handler never waits on the engine or disables interrupts.
 */
 
 #ifndef RP2040_VOLUME
 #define RP2040_VOLUME
 #include "hardware/pwm.h"
 #include "hardware/gpio.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "hardware/irq.h"
+#include "hardware/timer.h"
+#include "hardware/pio.h"
 #include "pico/time.h"
+#include "pico/multicore.h"
 #include <math.h>
+#include <new>
 
 
 #define TIME_MS     0
 #define TIME_US     1
 
+#define TONE_ENGINE_TIMER   0
+#define TONE_ENGINE_DMA     1
+#define TONE_ENGINE_NCO     2
+#define TONE_ENGINE_MIXER   3
+#define TONE_ENGINE_PIO     4
+
+// OR into the engine to run it on core 1, see RP2040_Tone_Core1
+#define TONE_ON_CORE1       0x80
+
+// Waveforms for set_waveform(), anything but square needs TONE_ENGINE_NCO
+#define TONE_WAVE_SQUARE    0
+#define TONE_WAVE_SINE      1
+#define TONE_WAVE_TRIANGLE  2
+#define TONE_WAVE_CUSTOM    3
+
+// Curves for sweep()
+#define TONE_SWEEP_LINEAR       0
+#define TONE_SWEEP_EXPONENTIAL  1
+
+// Default volume resolution (the slice's TOP), see set_carrier()
 #define TOP 1000
 
-// Allow overrides if the default timer is already in use
+// The one hardware alarm shared by every RP2040_Volume instance. Allow
+// overrides if the default timer is already in use
 #ifndef TONE_ALARM_POOL_HARDWARE_ALARM_NUM
 #define TONE_ALARM_POOL_HARDWARE_ALARM_NUM 3
 #endif
 
+// The alarm for instances whose engine runs on core 1 (TONE_ON_CORE1, or
+// constructed there), claimed the first time core 1 schedules something
+#ifndef TONE_ALARM_CORE1_HARDWARE_ALARM_NUM
+#define TONE_ALARM_CORE1_HARDWARE_ALARM_NUM 2
+#endif
 
-struct timer_data {
+// Scheduled events due within this many us of each other are serviced by the
+// same interrupt
+#ifndef TONE_SCHEDULER_SLACK_US
+#define TONE_SCHEDULER_SLACK_US 2
+#endif
+
+// Carrier periods rendered per DMA block by the buffered (NCO) engine. Each
+// block costs one interrupt; two blocks per instance are kept in RAM.
+#ifndef TONE_STREAM_BLOCK
+#define TONE_STREAM_BLOCK 128
+#endif
+
+// Number of instances that can use a buffered engine at the same time
+#ifndef TONE_STREAM_BUFFERS
+#define TONE_STREAM_BUFFERS 2
+#endif
+
+// Blocks of TONE_STREAM_BLOCK samples in each begin_stream() ring
+#ifndef TONE_SINK_BLOCKS
+#define TONE_SINK_BLOCKS 8
+#endif
+
+// Number of instances that can run begin_stream() at the same time
+#ifndef TONE_SINK_RINGS
+#define TONE_SINK_RINGS 1
+#endif
+
+// Voices per instance for TONE_ENGINE_MIXER
+#ifndef TONE_MAX_VOICES
+#define TONE_MAX_VOICES 8
+#endif
+
+// Number of instances that can use TONE_ENGINE_MIXER at the same time, each
+// with a bank of TONE_MAX_VOICES voices
+#ifndef TONE_MIXERS
+#define TONE_MIXERS 1
+#endif
+
+// Notes each instance can hold waiting to be played (one slot is kept free)
+#ifndef TONE_QUEUE_LENGTH
+#define TONE_QUEUE_LENGTH 16
+#endif
+
+// Commands that can be waiting for core 1 (one slot is kept free)
+#ifndef TONE_CORE1_QUEUE_LENGTH
+#define TONE_CORE1_QUEUE_LENGTH 32
+#endif
+
+// dial() timing: each digit's tones, then the silence before the next digit
+#ifndef TONE_DTMF_TONE_US
+#define TONE_DTMF_TONE_US 70000
+#endif
+#ifndef TONE_DTMF_GAP_US
+#define TONE_DTMF_GAP_US 70000
+#endif
+
+// Instances RP2040_Tone_Channels can hold (at most 32), one per PWM slice by
+// default
+#ifndef TONE_MAX_CHANNELS
+#define TONE_MAX_CHANNELS 8
+#endif
+
+// Instances an RP2040_Tone_Group can start together
+#ifndef TONE_GROUP_MAX_MEMBERS
+#define TONE_GROUP_MAX_MEMBERS 8
+#endif
+
+// tone_from_isr() requests that can be waiting, per core (one slot is kept
+// free)
+#ifndef TONE_ISR_QUEUE_LENGTH
+#define TONE_ISR_QUEUE_LENGTH 8
+#endif
+
+// Build with TONE_STATS 1 for the interrupt counters behind get_stats(),
+// about 40 cycles per callback. Off, they cost nothing and read as zero.
+#ifndef TONE_STATS
+#define TONE_STATS 0
+#endif
+
+// Scheduler callbacks running more than this many us after their deadline
+// count as late in tone_stats
+#ifndef TONE_STATS_LATE_US
+#define TONE_STATS_LATE_US 10
+#endif
+
+// Latency histogram buckets: 0 us, 1, 2-3, 4-7 ... and everything above
+#define TONE_STATS_BUCKETS 8
+
+#if TONE_STATS
+#include "hardware/structs/systick.h"
+#endif
+
+/// @brief MIDI note number (0-127) to frequency and half period, generated at
+/// compile time so sequencers can start notes with no math at all. MIDI note
+/// 0 (8.18 Hz) is still above the ~7.5 Hz minimum.
+struct tone_midi_table {
     public:
-      uint32_t   numRepeats;
-      uint32_t   repeats;
-      bool       high;
-      uint8_t    pinPlus;
-      uint8_t    pinMinus;
-      uint8_t    sliceNum;
-      bool       diff;
-      uint16_t   level;
+      uint32_t   freq_mHz[128];
+      uint32_t   halfPeriodUs[128];
+
+      constexpr tone_midi_table() : freq_mHz(), halfPeriodUs() {
+        for (int n = 0; n < 128; n++) {
+          // 440 Hz * 2^((n - 69)/12), as whole octaves then a few semitones
+          int semis = n - 69;
+          double f = 440.0;
+          while (semis < 0) {
+            f /= 2.0;
+            semis += 12;
+          }
+          while (semis >= 12) {
+            f *= 2.0;
+            semis -= 12;
+          }
+          while (semis-- > 0) {
+            f *= 1.0594630943592953; // 2^(1/12)
+          }
+          freq_mHz[n] = (uint32_t)(f * 1000.0 + 0.5);
+          halfPeriodUs[n] = (uint32_t)(500000.0 / f + 0.5);
+        }
+      }
 };
 
-class RP2040_Volume{
+static constexpr tone_midi_table TONE_MIDI_TABLE = tone_midi_table();
+
+/// @brief One period of a sine wave in Q15 (-32767..32767), generated at
+/// compile time. Used as the TONE_WAVE_SINE wavetable, indexed by the top 8
+/// bits of the NCO phase.
+struct tone_sine_table {
     public:
-      /// @brief Initialize pins for use in tone generation. In differential
-      /// mode, you must use pins on the same slice of the RP2040 PWM. You can
-      /// initialize as many of these as you like for different pins to drive
-      /// multiple outputs. Will hard fail an assert if pins are not on same
-      /// PWM slice.
-      /// @param pin_plus GPIO Pin number for + lead
-      /// @param pin_minus GPIO Pin number for - lead
+      int16_t    value[256];
 
-      RP2040_Volume(uint8_t pin_plus, uint8_t pin_minus = 255) {
+      constexpr tone_sine_table() : value() {
+        for (int i = 0; i < 256; i++) {
+          // Taylor series over -pi..pi is plenty accurate for 16 bits
+          double x = 3.14159265358979324 * (i < 128 ? i : i - 256) / 128.0;
+          double term = x;
+          double sum = x;
+          for (int n = 3; n < 30; n += 2) {
+            term *= -x * x / ((n - 1) * n);
+            sum += term;
+          }
+          value[i] = (int16_t)(sum * 32767.0 + (sum < 0 ? -0.5 : 0.5));
+        }
+      }
+};
 
-          if (pin_minus != 255) {
-            _diff = true;
-          } else {
-            _diff = false;
+static constexpr tone_sine_table TONE_SINE_TABLE = tone_sine_table();
+
+/// @brief The 16 DTMF keys and their row (low) and column (high) tones, in
+/// keypad order.
+struct tone_dtmf_table {
+    public:
+      char       key[16];
+      uint32_t   low_mHz[16];
+      uint32_t   high_mHz[16];
+
+      constexpr tone_dtmf_table() : key(), low_mHz(), high_mHz() {
+        const char keys[] = "123A456B789C*0#D";
+        const uint32_t rows[4] = {697000, 770000, 852000, 941000};
+        const uint32_t cols[4] = {1209000, 1336000, 1477000, 1633000};
+        for (int i = 0; i < 16; i++) {
+          key[i] = keys[i];
+          low_mHz[i] = rows[i / 4];
+          high_mHz[i] = cols[i % 4];
+        }
+      }
+
+      /// @brief Table index of a key (lower case a-d accepted)
+      /// @return -1 if it isn't a DTMF key
+      int find(char c) const {
+        if (c >= 'a' && c <= 'd') {
+          c = (char)(c - 'a' + 'A');
+        }
+        for (int i = 0; i < 16; i++) {
+          if (key[i] == c) {
+            return i;
           }
-          
-          _sliceNum = pwm_gpio_to_slice_num(pin_plus);
+        }
+        return -1;
+      }
+};
 
-          if (_diff) {
-            _pinPlus = pin_plus;
-            _pinMinus = pin_minus;
+static constexpr tone_dtmf_table TONE_DTMF_TABLE = tone_dtmf_table();
 
-            assert (pwm_gpio_to_slice_num(_pinMinus) == _sliceNum);
+/// Attack/decay/sustain/release as set by set_envelope()
+struct tone_adsr {
+    public:
+      uint32_t   attackUs;
+      uint32_t   decayUs;
+      uint32_t   sustain;      // Q16, 65536 = the note's level
+      uint32_t   releaseUs;
+      bool       on;
+};
 
-            gpio_set_function(_pinPlus, GPIO_FUNC_PWM);
-            gpio_set_function(_pinMinus, GPIO_FUNC_PWM);
+/// Envelope progress of the note being played
+struct tone_envelope_state {
+    public:
+      uint32_t   value;        // Q16, 65536 = the note's level
+      uint8_t    stage;
+};
 
+/// The envelope of one note in the engine's own ticks (timer engine: periods
+/// of the tone, buffered engines: stream blocks), so stepping it from an
+/// interrupt is an add and a couple of compares.
+struct tone_envelope {
+    public:
+      enum {
+        ATTACK,
+        DECAY,
+        SUSTAIN,
+        RELEASE,
+      };
+
+      uint32_t   attackStep;   // Q16 change per tick, 0 for no attack
+      uint32_t   decayStep;
+      uint32_t   sustain;      // Q16, 65536 = the note's level
+      uint32_t   releaseStep;
+      uint32_t   releaseTicks; // Release starts this many ticks before the end
+      bool       on;
+
+      void start(tone_envelope_state &state) const {
+        if (attackStep == 0) {
+          state.value = 65536;
+          state.stage = DECAY;
+        } else {
+          state.value = 0;
+          state.stage = ATTACK;
+        }
+      }
+
+      /// @brief Advance one tick
+      /// @param ticksLeft Whole ticks left in the note after this one
+      /// @return The new envelope value (Q16)
+      uint32_t __not_in_flash_func(step)(tone_envelope_state &state,
+                                         uint32_t ticksLeft) const {
+        uint32_t value = state.value;
+        if (ticksLeft < releaseTicks) {
+          state.stage = RELEASE;
+        }
+        switch (state.stage) {
+          case ATTACK:
+            value += attackStep;
+            if (value >= 65536) {
+              value = 65536;
+              state.stage = DECAY;
+            }
+            break;
+          case DECAY:
+            if (value > sustain + decayStep) {
+              value -= decayStep;
+            } else {
+              value = sustain;
+              state.stage = SUSTAIN;
+            }
+            break;
+          case RELEASE:
+            value = value > releaseStep ? value - releaseStep : 0;
+            break;
+        }
+        state.value = value;
+        return value;
+      }
+};
+
+/// A frequency sweep in the engine's own units (timer engine: mHz stepped
+/// once per period, buffered engines: phase increment stepped once per
+/// block). Linear sweeps add a fixed step per unit of elapsed time,
+/// exponential ones multiply by a fixed ratio, both worked out when the
+/// note is made.
+struct tone_sweep {
+    public:
+      uint64_t   pos;          // Current value, Q16
+      union {
+        int64_t  step;         // Linear: Q16 change per unit of dt
+        uint32_t ratio;        // Exponential: Q30 factor per tick
+      };
+      uint32_t   ticksLeft;    // Steps left before holding the end value
+      uint8_t    curve;
+      bool       perUs;        // Linear step is per microsecond, not per tick
+      bool       on;
+
+      /// @brief Advance one tick
+      /// @param dt Length of the tick that just ended, for linear sweeps
+      /// @return The new value
+      uint32_t __not_in_flash_func(next)(uint32_t dt = 1) {
+        if (ticksLeft > 0) {
+          ticksLeft--;
+          if (curve == TONE_SWEEP_LINEAR) {
+            pos += step * (int64_t)dt;
           } else {
-            _pinPlus = pin_plus;
-            _pinMinus = 255;
-            gpio_set_function(_pinPlus, GPIO_FUNC_PWM);
+            pos = ((pos >> 16) * ratio) >> 14;
           }
+        }
+        return (uint32_t)(pos >> 16);
       }
+};
 
-      /////////////////
-      ~RP2040_Volume() {
-        cancel_repeating_timer(&_timer);
-        delete _timerData;
-        alarm_pool_destroy(_alarmPool);
-      }
-      /////////////////
+/// A note already converted to engine units so it can be loaded straight from
+/// an interrupt. Rests are notes with a level of 0.
+struct tone_note {
+    public:
+      uint64_t   durationUs;   // DMA/PIO engines and deadline timing: length
+      uint32_t   ccWords[2];   // Slice CC register for the low/high half
+      // Only the engine the note was made for is filled in, see make_note()
+      union {
+        struct {
+          uint32_t usPerWave;  // Half period (us)
+          uint32_t numRepeats; // Half periods to play
+        } timer;               // Timer engine
+        struct {
+          uint32_t halfCarriers; // Carrier periods per half period
+        } dma;                 // DMA and PIO engines
+        struct {
+          uint32_t phaseInc;   // Phase step per carrier period
+          uint32_t samples;    // Length in carrier periods
+          uint32_t phaseInc2;  // Second tone of a dual tone, or 0
+          uint32_t gapSamples; // Silence at the end of samples
+        } nco;                 // NCO and mixer engines
+      };
+      uint16_t   level;
+      tone_envelope envelope;
+      tone_sweep sweep;
+};
 
-      /// @brief Non-blocking tone generation using hardware PWM and timer.
-      /// Wait until the tone has completed before starting a new one or the
-      /// previous tone will get overwritten. Error in frequency increases with
-      /// target frequency exponentially, becoming approximately ~200 Hz at
-      /// 20 kHz.
-      /// @param freq (Hz)
-      /// @param volume (0-100) Only accurate to the tenths position (95.11 = 95.1)
-      /// @param duration (in units of time)
-      /// @param time Timebase, TIME_MS or TIME_US for specifying duration
-      void tone(float freq, float volume, uint16_t duration, uint8_t time = TIME_MS) {
-        uint32_t usPerWave = freq_to_us(freq);
-        pwm_config config = pwm_get_default_config();
-        
-        // Disable these outputs while we configure:
-        pwm_set_enabled(_sliceNum, false);
+/// A note as the caller asked for it, in integer units. Cheap to build and
+/// copy, so it's what gets handed to core 1; converting to a tone_note
+/// happens on whichever core runs the engine.
+struct tone_request {
+    public:
+      uint32_t   freq_mHz;     // 0 for a rest
+      uint32_t   usPerWave;    // Half period, already known for MIDI notes
+      uint64_t   durationUs;
+      uint32_t   level;        // Fraction of full volume, 65536 = 100%
+      uint32_t   endFreq_mHz;  // Sweep to this frequency, 0 for a plain note
+      uint8_t    curve;        // TONE_SWEEP_LINEAR or _EXPONENTIAL
+      uint32_t   freq2_mHz;    // Second tone of a dual tone, 0 for one tone
+      uint32_t   gapUs;        // Silence after a dual tone, inside the note
+};
 
-        // Turn on phase correction:
-        pwm_config_set_phase_correct(&config, true);
+/// @brief freq_to_us() and the per mille to Q16 volume conversion, usable
+/// at compile time for tone patches
+constexpr uint32_t tone_half_period_us(uint32_t freq_mHz) {
+  return freq_mHz == 0 ? 1 : ((500000000u + freq_mHz / 2) / freq_mHz > 0
+                              ? (500000000u + freq_mHz / 2) / freq_mHz : 1);
+}
 
-        // Run PWM at full speed
-        pwm_config_set_clkdiv_int(&config, 1);
+constexpr uint32_t tone_permille_level(uint16_t level_permille) {
+  return ((uint32_t)(level_permille > 1000 ? 1000 : level_permille) << 16) / 1000;
+}
 
-        // Specify what the PWM counter rolls over at:
-        pwm_config_set_wrap(&config, TOP);
+/// @brief A patch note: freq_mHz at level_permille (0-1000) for duration_us.
+/// Worked out at compile time when used in a constexpr patch.
+constexpr tone_request tone_patch_note(uint32_t freq_mHz, uint16_t level_permille,
+                                       uint32_t duration_us) {
+  return tone_request{freq_mHz, tone_half_period_us(freq_mHz), duration_us,
+                      tone_permille_level(level_permille), 0, TONE_SWEEP_LINEAR, 0, 0};
+}
 
-        // Initialize, but don't start yet:
-        pwm_init(_sliceNum, &config, false);
+/// @brief A patch MIDI note (0-127), see tone_midi()
+constexpr tone_request tone_patch_midi(uint8_t note, uint16_t level_permille,
+                                       uint32_t duration_us) {
+  return tone_patch_note(TONE_MIDI_TABLE.freq_mHz[note & 0x7f], level_permille, duration_us);
+}
 
-        if (volume > 100) {
-          volume = 100;
+/// @brief A patch sweep, see sweep_fixed()
+constexpr tone_request tone_patch_sweep(uint32_t start_mHz, uint32_t end_mHz,
+                                        uint16_t level_permille, uint32_t duration_us,
+                                        uint8_t curve = TONE_SWEEP_LINEAR) {
+  return tone_request{start_mHz, tone_half_period_us(start_mHz), duration_us,
+                      tone_permille_level(level_permille), end_mHz, curve, 0, 0};
+}
+
+/// @brief A patch silence
+constexpr tone_request tone_patch_rest(uint32_t duration_us) {
+  return tone_request{0, 0, duration_us, 0, 0, TONE_SWEEP_LINEAR, 0, 0};
+}
+
+/// @brief An envelope for a whole patch, see set_envelope()
+constexpr tone_adsr tone_patch_envelope(uint32_t attack_us, uint32_t decay_us,
+                                        uint16_t sustain_permille, uint32_t release_us) {
+  return tone_adsr{attack_us, decay_us, tone_permille_level(sustain_permille), release_us,
+                   attack_us != 0 || release_us != 0 || sustain_permille < 1000};
+}
+
+/// @brief An alert sound built once, ideally as a constexpr in flash, and
+/// played with RP2040_Volume::play() on any number of instances. The notes
+/// are already in integer units with their half periods worked out, so
+/// playing one is a handful of integer ops per note and a single slice
+/// init. The whole patch is queued at once, so it can be at most
+/// TONE_QUEUE_LENGTH notes long.
+///
+///     static constexpr tone_request CHIME[] = {
+///       tone_patch_note(880000, 800, 120000), tone_patch_rest(40000),
+///       tone_patch_note(1320000, 800, 240000),
+///     };
+///     static constexpr tone_patch CHIME_PATCH(CHIME, tone_patch_envelope(5000, 0, 1000, 60000));
+///     speaker.play(CHIME_PATCH);
+struct tone_patch {
+    public:
+      const tone_request *steps;
+      uint8_t    length;
+      tone_adsr  adsr;         // Used instead of set_envelope()'s if on
+
+      template<size_t N>
+      constexpr tone_patch(const tone_request (&notes)[N], tone_adsr envelope = tone_adsr())
+        : steps(notes), length((uint8_t)N), adsr(envelope) {
+        static_assert(N >= 1 && N <= TONE_QUEUE_LENGTH, "patch must fit in the note queue");
+      }
+};
+
+/// One voice of the mixer engine. The caller only ever fills in a voice that
+/// isn't active; the DMA interrupt clears active when the voice runs out.
+struct tone_voice {
+    public:
+      uint32_t   phase;
+      uint32_t   phaseInc;
+      uint32_t   phase2;       // Second tone of a dual tone
+      uint32_t   phaseInc2;
+      uint32_t   samplesLeft;
+      int32_t    level;        // Current level, peak scaled by the envelope
+      int32_t    peak;
+      tone_envelope envelope;
+      tone_envelope_state envState;
+      tone_sweep sweep;
+      volatile bool active;
+};
+
+/// Bounded ring with a single producer and a single consumer, safe across
+/// an interrupt or the other core without locks.
+template <typename T, uint32_t N>
+struct tone_ring {
+    public:
+      T                  items[N];
+      volatile uint32_t  head = 0; // Next item the consumer will take
+      volatile uint32_t  tail = 0; // Next free slot
+
+      bool empty() const {
+        return head == tail;
+      }
+
+      /// @brief Only call from the producer side. In RAM, as tone_from_isr()
+      /// pushes from interrupt handlers.
+      /// @return false if the ring is full
+      bool __not_in_flash_func(push)(const T &item) {
+        uint32_t next = tail + 1;
+        if (next == N) {
+          next = 0;
         }
+        if (next == head) {
+          return false;
+        }
+        items[tail] = item;
+        __dmb(); // item must be visible before the consumer can see the slot
+        tail = next;
+        return true;
+      }
 
-        if (volume < 0) {
-          volume = 0;
+      /// @brief Only call from the consumer side
+      /// @return false if there was nothing queued
+      bool __not_in_flash_func(pop)(T &item) {
+        if (empty()) {
+          return false;
         }
-        
-        _level = (uint16_t)round(volume * 10.0f);
+        __dmb(); // don't read the slot before seeing it published
+        item = items[head];
+        uint32_t next = head + 1;
+        if (next == N) {
+          next = 0;
+        }
+        head = next;
+        return true;
+      }
 
-        pwm_set_gpio_level(_pinPlus, 0);
+      /// @brief Only safe while the consumer is stopped
+      void clear() {
+        head = tail;
+      }
+};
 
-        if (_diff) {
-          pwm_set_gpio_level(_pinMinus, _level);
+/// Notes waiting to be played, the engine's interrupt is the consumer
+typedef tone_ring<tone_note, TONE_QUEUE_LENGTH> tone_queue;
+
+/// Called when a note finishes from the interrupt that ended it; last is
+/// true once the queue has run dry and the engine has stopped
+typedef void (*tone_done_callback_t)(void *user_data, bool last);
+
+struct timer_data {
+    public:
+      uint32_t   numRepeats;
+      uint32_t   repeats;
+      uint32_t   high;         // Index into ccWords of the half being played
+      volatile uint32_t *cc;   // The slice's CC register
+      // Both channels' levels for each half, so an edge is one 32-bit store
+      // regardless of single-ended/differential
+      uint32_t   ccWords[2];
+      tone_queue *queue;
+      volatile bool active; // true while the engine is playing or draining queue
+
+      // Envelope and sweep, stepped once per period of the tone
+      tone_sweep sweep;
+      tone_envelope envelope;
+      tone_envelope_state envState;
+      uint32_t   peak;         // The note's level
+      uint8_t    shiftPlus;    // Bit offset of each pin's level in CC
+      uint8_t    shiftMinus;
+      bool       diff;
+
+      // set_deadline_timing(): the note ends at endAt instead of after
+      // numRepeats edges
+      bool       deadline;
+      uint64_t   endAt;        // us since boot
+
+      // set_done_callback()
+      tone_done_callback_t done;
+      void      *doneData;
+
+      // set_idle_timeout(): armed when the engine runs dry, 0 for never
+      struct tone_event *idle;
+      uint32_t   idleUs;
+};
+
+/// A call handed to another context (core 1 or the ISR software interrupt):
+/// run(target, command) is executed there
+struct tone_command {
+    public:
+      void     (*run)(void *target, const struct tone_command &command);
+      void      *target;
+      uint8_t    op;
+      int8_t     voice;
+      tone_request request;
+      const tone_patch *patch; // TONE_OP_PATCH only
+};
+
+typedef tone_ring<tone_command, TONE_ISR_QUEUE_LENGTH> tone_isr_ring;
+
+/// Interrupt timing and cost from get_stats(), counted by the scheduler
+/// (alarm callbacks) and the shared DMA interrupt (stream blocks) when built
+/// with TONE_STATS. Latency is how late a scheduler callback ran against its
+/// deadline; cycles come from the running core's SysTick, so CPU load is
+/// cycles / (clk_sys Hz * (now - sinceUs) / 1e6).
+struct tone_stats {
+    public:
+      uint32_t   callbacks;    // Alarm callbacks and DMA interrupts
+      uint32_t   lateMinUs;    // UINT32_MAX until the first alarm callback
+      uint32_t   lateMaxUs;
+      uint32_t   lateHist[TONE_STATS_BUCKETS]; // [i]: latency below 2^i us
+      uint32_t   late;         // More than TONE_STATS_LATE_US late
+      uint32_t   dropped;      // Ran after the next one was due (an edge lost)
+      uint32_t   underruns;    // Stream blocks that ran out of notes or samples
+      uint32_t   cyclesMax;    // Longest single callback
+      uint64_t   cycles;       // Total spent in callbacks
+      uint64_t   sinceUs;      // reset_stats() (or boot), us since boot
+
+      constexpr tone_stats()
+          : callbacks(0), lateMinUs(UINT32_MAX), lateMaxUs(0), lateHist(), late(0),
+            dropped(0), underruns(0), cyclesMax(0), cycles(0), sinceUs(0) {}
+
+      void reset(uint64_t now) {
+        *this = tone_stats();
+        sinceUs = now;
+      }
+
+      /// @brief Fold another block's counts into this one
+      void add(const tone_stats &other) {
+        callbacks += other.callbacks;
+        lateMinUs = other.lateMinUs < lateMinUs ? other.lateMinUs : lateMinUs;
+        lateMaxUs = other.lateMaxUs > lateMaxUs ? other.lateMaxUs : lateMaxUs;
+        for (int i = 0; i < TONE_STATS_BUCKETS; i++) {
+          lateHist[i] += other.lateHist[i];
         }
+        late += other.late;
+        dropped += other.dropped;
+        underruns += other.underruns;
+        cyclesMax = other.cyclesMax > cyclesMax ? other.cyclesMax : cyclesMax;
+        cycles += other.cycles;
+        sinceUs = other.sinceUs < sinceUs ? other.sinceUs : sinceUs;
+      }
 
-        // Now we need to set up our timer stuff:
-        switch (time) {
-          case TIME_US:
-            _numRepeats = (uint32_t)duration/usPerWave;
-            break;
-          case TIME_MS:
-            _numRepeats = (uint32_t)1000*duration/usPerWave;
-            break;
+      void __not_in_flash_func(add_cycles)(uint32_t spent) {
+        callbacks++;
+        cycles += spent;
+        if (spent > cyclesMax) {
+          cyclesMax = spent;
         }
+      }
 
-        
-        if (_timerData != NULL) {
-          cancel_repeating_timer(&_timer);
-          delete _timerData;
+      /// @param period When the callback asked to run again, 0 if not
+      void __not_in_flash_func(add_latency)(uint32_t us, uint64_t period) {
+        if (us < lateMinUs) {
+          lateMinUs = us;
         }
-        
-        _timerData = new timer_data();
-        _timerData->numRepeats = _numRepeats;
-        _timerData->repeats = 0;
-        _timerData->high = false; // starts as false so we turn it off first.
-        _timerData->pinPlus = _pinPlus;
-        _timerData->pinMinus = _pinMinus;
-        _timerData->sliceNum = _sliceNum;
-        _timerData->diff = _diff;
-        _timerData->level = _level;
+        if (us > lateMaxUs) {
+          lateMaxUs = us;
+        }
+        uint32_t bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+        lateHist[bucket < TONE_STATS_BUCKETS ? bucket : TONE_STATS_BUCKETS - 1]++;
+        if (us > TONE_STATS_LATE_US) {
+          late++;
+        }
+        if (period != 0 && us >= period) {
+          dropped++;
+        }
+      }
+};
+
+/// A deadline on RP2040_Tone_Scheduler. callback runs from the alarm
+/// interrupt and returns true to run again delay_us after the deadline it was
+/// due at (so repeating events don't drift), or false to stop.
+struct tone_event {
+    public:
+      bool     (*callback)(struct tone_event *event);
+      void      *user_data;
+      uint64_t   delay_us;
+      uint64_t   deadline;     // us since boot
+      struct tone_event *next; // Only touched by the scheduler
+      bool       scheduled;
+      uint8_t    core;         // Whose list it's on, set by the scheduler
+#if TONE_STATS
+      tone_stats *stats;       // The owner's, or NULL for just the global ones
+#endif
+};
 
-        // The default pool is not created for some reason, so we need to
-        // make it ourselves. 
+typedef bool (*tone_event_callback_t)(struct tone_event *event);
 
-        if (_alarmPool != NULL) {
-          alarm_pool_destroy(_alarmPool);
+/// @brief Process-wide scheduler shared by every RP2040_Volume instance. All
+/// of their timing (timer engine edges, DMA engine note ends) lives in one
+/// list per core sorted by deadline, driven by one hardware alarm per core
+/// (TONE_ALARM_POOL_HARDWARE_ALARM_NUM on core 0,
+/// TONE_ALARM_CORE1_HARDWARE_ALARM_NUM on core 1), so any number of speakers
+/// costs one alarm per core in use. An event goes on the list of the core
+/// that schedules it, which is always the core running its engine, so each
+/// engine's callbacks run on that core's alarm IRQ. Each interrupt services
+/// every event due within TONE_SCHEDULER_SLACK_US and re-arms for the
+/// earliest one left. Re-inserting an event walks the list from the front, a
+/// few entries for the handful of speakers a chip can drive. Each list has
+/// its own spin lock, so the two cores never wait on each other's alarms.
+/// Callbacks run with their core's lock held, so they must not call back
+/// into the scheduler (other than the _from_callback functions).
+class RP2040_Tone_Scheduler {
+    public:
+      /// @brief Claim the calling core's spin lock and hardware alarm the
+      /// first time on each core (the alarm's IRQ is enabled on that core).
+      /// Only touches the calling core's state, so both cores can call it at
+      /// once. Not safe from an interrupt.
+      static void init() {
+        uint core = get_core_num();
+        if (_lock(core) == NULL) {
+          _lock(core) = spin_lock_instance(spin_lock_claim_unused(true));
         }
+        if (!_alarmClaimed()[core]) {
+          hardware_alarm_claim(alarm_num(core));
+          hardware_alarm_set_callback(alarm_num(core), alarm_irq_handler);
+          _alarmClaimed()[core] = true;
+        }
+      }
 
-        _alarmPool = alarm_pool_create(
-                TONE_ALARM_POOL_HARDWARE_ALARM_NUM,
-                PICO_TIME_DEFAULT_ALARM_POOL_MAX_TIMERS
-                );
+      /// @brief (Re)start an event delay_us from now. The caller fills in
+      /// callback, user_data and delay_us first.
+      static void schedule_in_us(tone_event *event, uint32_t delay_us) {
+        schedule_at(event, time_us_64() + delay_us);
+      }
 
+      /// @brief (Re)start an event at an absolute time (us since boot), so
+      /// several events can share exactly the same timebase
+      static void schedule_at(tone_event *event, uint64_t deadline) {
+        init();
+        uint core = get_core_num();
+        if (event->scheduled && event->core != core) {
+          cancel(event); // off the other core's list, under its lock
+        }
+        uint32_t save = spin_lock_blocking(_lock(core));
+        unlink(event);
+        event->deadline = deadline;
+        event->core = (uint8_t)core;
+        insert(event);
+        if (_head(core) == event &&
+            hardware_alarm_set_target(alarm_num(core),
+                                      from_us_since_boot(event->deadline))) {
+          service(core); // already due
+        }
+        spin_unlock(_lock(core), save);
+      }
 
-        alarm_pool_add_repeating_timer_us(_alarmPool, usPerWave,
-                              timer_cb, (void *)_timerData, &_timer);
-        
-        pwm_set_counter(_sliceNum, 0);
+      /// @brief Stop an event, from either core, under the lock of the core
+      /// whose list it's on. Events that aren't scheduled are ignored. Once
+      /// this returns the callback is not running and won't run again.
+      static void cancel(tone_event *event) {
+        for (;;) {
+          uint core = event->core;
+          spin_lock_t *lock = _lock(core);
+          if (lock == NULL) {
+            return; // that core never scheduled anything
+          }
+          uint32_t save = spin_lock_blocking(lock);
+          bool same = event->core == core;
+          if (same) {
+            unlink(event);
+          }
+          spin_unlock(lock, save);
+          if (same) {
+            return;
+          }
+          // Rescheduled onto the other core meanwhile, go after it there
+        }
+      }
 
-        pwm_set_enabled(_sliceNum, true); // Turn on PWM now that we're all set
+      /// @brief schedule_at() for use inside a callback, where the lock is
+      /// already held. The event can be due straight away, it's picked up
+      /// before the interrupt returns.
+      static void __not_in_flash_func(schedule_from_callback)(tone_event *event,
+                                                              uint64_t deadline) {
+        unlink(event);
+        event->deadline = deadline;
+        event->core = (uint8_t)get_core_num();
+        insert(event);
       }
 
-      /// @brief Turns off the timer and puts PWM pins low
-      void stop_tone() {
+      /// @brief cancel() for use inside a callback
+      static void __not_in_flash_func(cancel_from_callback)(tone_event *event) {
+        unlink(event);
+      }
 
-        cancel_timer();
-        delete _timerData;
-        _timerData = NULL;
-        alarm_pool_destroy(_alarmPool);
-        _alarmPool = NULL;
+      typedef void (*dma_callback_t)(uint channel, void *user_data);
 
-        // Set PWMs to low
-        pwm_set_gpio_level(_pinPlus, 0);
-        if (_diff) {
-          pwm_set_gpio_level(_pinMinus, 0);
+      /// @brief Route a channel's completions (see dma_irq_num()) to a
+      /// callback. Pass NULL to stop routing.
+      static void set_dma_callback(uint channel, dma_callback_t callback,
+                                   void *user_data, tone_stats *stats = NULL) {
+        dma_slot *slot = &dma_slots()[channel];
+        slot->callback = NULL;
+        __dmb();
+        slot->userData = user_data;
+#if TONE_STATS
+        slot->stats = stats;
+#else
+        (void)stats;
+#endif
+        __dmb();
+        slot->callback = callback;
+      }
+
+      /// @brief Install the shared DMA handler on the calling core, the first
+      /// time on each core. Called when an engine starts, so it lands on the
+      /// core that runs the engine.
+      static void install_dma_irq() {
+        static bool s_installed[NUM_CORES] = {};
+        uint core = get_core_num();
+        if (!s_installed[core]) {
+          irq_add_shared_handler(dma_irq_num(core), dma_irq_handler,
+                                 PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+          irq_set_enabled(dma_irq_num(core), true);
+          s_installed[core] = true;
         }
       }
 
-    private:
-      uint16_t            _level;
-      uint8_t             _pinPlus;
-      uint8_t             _pinMinus;
-      uint8_t             _sliceNum;
-      bool                _diff = false;
+      /// @brief The DMA IRQ line for engines on a core: DMA_IRQ_1 on core 0
+      /// and DMA_IRQ_0 on core 1. Each line is only enabled on its own core,
+      /// so a channel's interrupt is taken by the core that runs its engine.
+      static uint dma_irq_num(uint core) {
+        return core == 0 ? DMA_IRQ_1 : DMA_IRQ_0;
+      }
 
-      struct timer_data  *_timerData = NULL;
-      uint32_t            _numRepeats;
-      alarm_pool_t       *_alarmPool = NULL;
-      repeating_timer_t   _timer = repeating_timer_t();
+      /// @brief INTE register of dma_irq_num(core)
+      static volatile uint32_t *dma_inte(uint core) {
+        return core == 0 ? &dma_hw->inte1 : &dma_hw->inte0;
+      }
 
-      
-      /// @brief Frequency (in Hz) to microsecond conversion for how often the
-      /// PWM inputs need to be switched to generate an appropriate wave.
-      /// @param freq (Hz)
-      /// @return uint32_t microseconds per half period (rounded)
-      uint32_t freq_to_us(float freq) {
-        return (uint32_t)round((1.0/(2.0*freq)) * 1e6); // Multiplied by 2 as we switch every half-cycle
+      /// @brief INTS register of dma_irq_num(core), write 1s to acknowledge
+      static volatile uint32_t *dma_ints(uint core) {
+        return core == 0 ? &dma_hw->ints1 : &dma_hw->ints0;
       }
 
-      static bool timer_cb(struct repeating_timer *data) {
-        struct timer_data *tData = (timer_data*)(data->user_data);
-        tData->repeats++;
-        if (tData->repeats >= tData->numRepeats) {
-          // Set PWMS to 0% duty cycle, but leave running so they go to low correctly
-          pwm_set_gpio_level(tData->pinPlus, 0);
-          if (tData->diff) {
-              pwm_set_gpio_level(tData->pinMinus, 0);
-          }
-          return false; // this stops when needed. Might be some slack in this...
+      /// @brief Claim a pair of TONE_STREAM_BLOCK word buffers from a static
+      /// pool for one of the buffered engines. Panics if none are left, same
+      /// as running out of DMA channels.
+      static uint32_t *claim_stream_buffer() {
+        uint32_t *claimed = _stream_pool(NULL);
+        if (claimed == NULL) {
+          panic("RP2040_Volume: out of stream buffers (TONE_STREAM_BUFFERS)");
         }
+        return claimed;
+      }
 
-        if (tData->diff) {
-          if (tData->high) {
-            pwm_set_gpio_level(tData->pinPlus, 0);
-            pwm_set_gpio_level(tData->pinMinus, tData->level);
-          } else {
-            pwm_set_gpio_level(tData->pinPlus, tData->level);
-            pwm_set_gpio_level(tData->pinMinus, 0);
-          }
-        } else {
-          if (tData->high) {
-            pwm_set_gpio_level(tData->pinPlus, 0);
-          } else {
-            pwm_set_gpio_level(tData->pinPlus, tData->level);
-          }
+      /// @brief Give a buffer from claim_stream_buffer() back to the pool
+      static void release_stream_buffer(uint32_t *buffer) {
+        _stream_pool(buffer);
+      }
+
+      /// @brief Claim a bank of TONE_MAX_VOICES idle voices from a static
+      /// pool for a mixer instance. Panics if none are left.
+      static tone_voice *claim_voices() {
+        tone_voice *claimed = _voice_pool(NULL);
+        if (claimed == NULL) {
+          panic("RP2040_Volume: out of mixer voices (TONE_MIXERS)");
         }
+        for (int v = 0; v < TONE_MAX_VOICES; v++) {
+          claimed[v] = tone_voice();
+        }
+        return claimed;
+      }
 
-        tData->high = !tData->high;
+      /// @brief Give a bank from claim_voices() back to the pool
+      static void release_voices(tone_voice *voices) {
+        _voice_pool(voices);
+      }
 
-        return true;
+      /// @brief Claim a ring of TONE_SINK_BLOCKS stream blocks for
+      /// begin_stream()
+      /// @return NULL if they are all in use
+      static uint32_t *claim_sink_ring() {
+        return _sink_pool(NULL);
+      }
 
+      /// @brief Give a ring from claim_sink_ring() back
+      static void release_sink_ring(uint32_t *ring) {
+        _sink_pool(ring);
       }
 
-      void cancel_timer() {
-        cancel_repeating_timer(&_timer);
+      /// @brief Claim a software (user) IRQ on the calling core to run
+      /// tone_from_isr() requests, the first time on each core. It sits at
+      /// the lowest priority so it runs once the posting handler has
+      /// returned. Also sets up the scheduler, which can't be done from an
+      /// interrupt.
+      static void install_isr_irq() {
+        init();
+        uint core = get_core_num();
+        if (_isr_irq(core) < 0) {
+          int irq = user_irq_claim_unused(true);
+          irq_set_exclusive_handler(irq, isr_irq_handler);
+          irq_set_priority(irq, PICO_LOWEST_IRQ_PRIORITY);
+          irq_set_enabled(irq, true);
+          _isr_irq(core) = irq;
+        }
       }
 
+      /// @brief Hand a command to a core's software IRQ from an interrupt
+      /// handler on that core. Each core has its own ring and IRQ, so the
+      /// two never share a producer; the NVIC can only pend an IRQ on the
+      /// core writing to it, so posting across cores is refused.
+      /// Wait-free: a copy into the ring and one NVIC write.
+      /// @param core The core running the engine
+      /// @return false if the ring is full, or called from the other core
+      static bool __not_in_flash_func(post_from_isr)(const tone_command &command, uint core) {
+        if (get_core_num() != core || _isr_irq(core) < 0) {
+          return false;
+        }
+        if (!isr_commands(core).push(command)) {
+          return false;
+        }
+        irq_set_pending(_isr_irq(core));
+        return true;
+      }
+
+      /// @brief Keep the calling core's software IRQ from running commands
+      /// while thread code is reconfiguring an engine, so the two never
+      /// interleave.
+      static void hold_isr_commands(bool hold) {
+        int irq = _isr_irq(get_core_num());
+        if (irq >= 0) {
+          irq_set_enabled(irq, !hold);
+        }
+      }
+
+      /// @brief Every instance's interrupts together, see tone_stats. Zeros
+      /// unless built with TONE_STATS. Each core counts into its own block,
+      /// only from its own alarm and DMA interrupts (which sit at the same
+      /// priority, so never interrupt each other), and they're added up here.
+      static tone_stats get_stats() {
+        tone_stats total = read_stats(&_stats(0), 0);
+        for (uint core = 1; core < NUM_CORES; core++) {
+          total.add(read_stats(&_stats(core), core));
+        }
+        return total;
+      }
+
+      /// @brief Start get_stats() over from now
+      static void reset_stats() {
+        for (uint core = 0; core < NUM_CORES; core++) {
+          clear_stats(&_stats(core), core);
+        }
+      }
+
+      /// @brief Copy a stats block, with the lock of the core counting into
+      /// it held so the alarm's counters are consistent (the DMA interrupt's
+      /// can be one block apart)
+      static tone_stats read_stats(const tone_stats *stats, uint core) {
+        if (_lock(core) == NULL) {
+          return *stats;
+        }
+        uint32_t save = spin_lock_blocking(_lock(core));
+        tone_stats copy = *stats;
+        spin_unlock(_lock(core), save);
+        return copy;
+      }
+
+#if TONE_STATS
+      /// @brief Count a stream underrun, from the DMA interrupt
+      static void __not_in_flash_func(add_underrun)(tone_stats *stats) {
+        stats->underruns++;
+        _stats(get_core_num()).underruns++;
+      }
+#endif
+
+      static void clear_stats(tone_stats *stats, uint core) {
+        if (_lock(core) == NULL) {
+          stats->reset(time_us_64()); // nothing counting into it yet
+          return;
+        }
+        uint32_t save = spin_lock_blocking(_lock(core));
+        stats->reset(time_us_64());
+        spin_unlock(_lock(core), save);
+      }
+
+    private:
+      static tone_event *&_head(uint core) {
+        static tone_event *s_heads[NUM_CORES] = {};
+        return s_heads[core];
+      }
+
+      static bool *_alarmClaimed() {
+        static bool s_claimed[NUM_CORES] = {};
+        return s_claimed;
+      }
+
+      static uint alarm_num(uint core) {
+        return core == 0 ? TONE_ALARM_POOL_HARDWARE_ALARM_NUM
+                         : TONE_ALARM_CORE1_HARDWARE_ALARM_NUM;
+      }
+
+      static tone_stats &_stats(uint core) {
+        static tone_stats s_stats[NUM_CORES];
+        return s_stats[core];
+      }
+
+#if TONE_STATS
+      /// @brief Read this core's SysTick to time a callback, starting it
+      /// free-running at clk_sys if nothing else has (an RTOS tick is left
+      /// alone and its reload used instead)
+      static uint32_t __not_in_flash_func(cycles_start)() {
+        if ((systick_hw->csr & 1) == 0) {
+          systick_hw->rvr = 0xffffff;
+          systick_hw->cvr = 0;
+          systick_hw->csr = 0x5; // enabled, processor clock, no interrupt
+        }
+        return systick_hw->cvr;
+      }
+
+      /// @brief Cycles since cycles_start(), the counter runs down
+      static uint32_t __not_in_flash_func(cycles_since)(uint32_t start) {
+        uint32_t now = systick_hw->cvr;
+        return start >= now ? start - now : start + systick_hw->rvr + 1 - now;
+      }
+#endif
+
+      static spin_lock_t *&_lock(uint core) {
+        static spin_lock_t *s_locks[NUM_CORES] = {};
+        return s_locks[core];
+      }
+
+      /// @brief Add an event in deadline order to its core's list, after any
+      /// due at the same time
+      static void __not_in_flash_func(insert)(tone_event *event) {
+        tone_event **link = &_head(event->core);
+        while (*link != NULL && (*link)->deadline <= event->deadline) {
+          link = &(*link)->next;
+        }
+        event->next = *link;
+        *link = event;
+        event->scheduled = true;
+      }
+
+      static void __not_in_flash_func(unlink)(tone_event *event) {
+        if (!event->scheduled) {
+          return;
+        }
+        tone_event **link = &_head(event->core);
+        while (*link != event) {
+          link = &(*link)->next;
+        }
+        *link = event->next;
+        event->scheduled = false;
+      }
+
+      /// @brief Run everything that's due on a core's list, then arm its
+      /// alarm for the next deadline. Called on that core with its lock held.
+      static void __not_in_flash_func(service)(uint core) {
+        for (;;) {
+          uint64_t due = time_us_64() + TONE_SCHEDULER_SLACK_US;
+          tone_event *event;
+          while ((event = _head(core)) != NULL && event->deadline <= due) {
+            _head(core) = event->next;
+            event->scheduled = false;
+#if TONE_STATS
+            uint64_t now = time_us_64();
+            uint32_t lateUs = now > event->deadline ? (uint32_t)(now - event->deadline) : 0;
+            uint32_t start = cycles_start();
+#endif
+            bool again = event->callback(event);
+#if TONE_STATS
+            uint32_t spent = cycles_since(start);
+            uint64_t period = again ? event->delay_us : 0;
+            _stats(core).add_cycles(spent);
+            _stats(core).add_latency(lateUs, period);
+            if (event->stats != NULL) {
+              event->stats->add_cycles(spent);
+              event->stats->add_latency(lateUs, period);
+            }
+#endif
+            if (again) {
+              event->deadline += event->delay_us;
+              insert(event);
+            }
+          }
+          if (event == NULL ||
+              !hardware_alarm_set_target(alarm_num(core),
+                                         from_us_since_boot(event->deadline))) {
+            return;
+          }
+          // Missed it while servicing the others, go round again
+        }
+      }
+
+      static void __not_in_flash_func(alarm_irq_handler)(uint alarm) {
+        uint core = alarm == TONE_ALARM_POOL_HARDWARE_ALARM_NUM ? 0 : 1;
+        uint32_t save = spin_lock_blocking(_lock(core));
+        service(core);
+        spin_unlock(_lock(core), save);
+      }
+
+      struct dma_slot {
+        volatile dma_callback_t callback;
+        void *userData;
+#if TONE_STATS
+        tone_stats *stats;
+#endif
+      };
+
+      static tone_isr_ring &isr_commands(uint core) {
+        static tone_isr_ring s_commands[NUM_CORES];
+        return s_commands[core];
+      }
+
+      static int &_isr_irq(uint core) {
+        static int s_irqs[NUM_CORES] = {-1, -1};
+        return s_irqs[core];
+      }
+
+      static void isr_irq_handler() {
+        tone_command command;
+        while (isr_commands(get_core_num()).pop(command)) {
+          command.run(command.target, command);
+        }
+      }
+
+      static dma_slot *dma_slots() {
+        static dma_slot s_slots[NUM_DMA_CHANNELS];
+        return s_slots;
+      }
+
+      static void __not_in_flash_func(dma_irq_handler)() {
+        dma_slot *slots = dma_slots();
+        uint core = get_core_num();
+        volatile uint32_t *ints = dma_ints(core);
+        uint32_t pending = *ints;
+        for (uint ch = 0; pending != 0; ch++, pending >>= 1) {
+          if ((pending & 1) && slots[ch].callback != NULL) {
+            *ints = 1u << ch; // only ack channels we own
+#if TONE_STATS
+            uint32_t start = cycles_start();
+            slots[ch].callback(ch, slots[ch].userData);
+            uint32_t spent = cycles_since(start);
+            _stats(core).add_cycles(spent);
+            if (slots[ch].stats != NULL) {
+              slots[ch].stats->add_cycles(spent);
+            }
+#else
+            slots[ch].callback(ch, slots[ch].userData);
+#endif
+          }
+        }
+      }
+
+      /// @brief Both halves of the stream buffer pool: claims a free buffer
+      /// if release is NULL, otherwise frees release.
+      static uint32_t *_stream_pool(uint32_t *release) {
+        static uint32_t s_buffers[TONE_STREAM_BUFFERS][2 * TONE_STREAM_BLOCK];
+        static bool s_used[TONE_STREAM_BUFFERS];
+        for (int i = 0; i < TONE_STREAM_BUFFERS; i++) {
+          if (release == NULL && !s_used[i]) {
+            s_used[i] = true;
+            return s_buffers[i];
+          }
+          if (release == s_buffers[i]) {
+            s_used[i] = false;
+            return NULL;
+          }
+        }
+        return NULL;
+      }
+
+      static tone_voice *_voice_pool(tone_voice *release) {
+        static tone_voice s_voices[TONE_MIXERS][TONE_MAX_VOICES];
+        static bool s_used[TONE_MIXERS];
+        for (int i = 0; i < TONE_MIXERS; i++) {
+          if (release == NULL && !s_used[i]) {
+            s_used[i] = true;
+            return s_voices[i];
+          }
+          if (release == s_voices[i]) {
+            s_used[i] = false;
+            return NULL;
+          }
+        }
+        return NULL;
+      }
+
+      static uint32_t *_sink_pool(uint32_t *release) {
+        static uint32_t s_rings[TONE_SINK_RINGS][TONE_SINK_BLOCKS * TONE_STREAM_BLOCK];
+        static bool s_used[TONE_SINK_RINGS];
+        for (int i = 0; i < TONE_SINK_RINGS; i++) {
+          if (release == NULL && !s_used[i]) {
+            s_used[i] = true;
+            return s_rings[i];
+          }
+          if (release == s_rings[i]) {
+            s_used[i] = false;
+            return NULL;
+          }
+        }
+        return NULL;
+      }
+};
+
+/// @brief Runs tone engines on core 1. Instances created with TONE_ON_CORE1
+/// post their calls here from core 0 (a copy into a lock-free ring and a
+/// __sev(), a few dozen cycles) and core 1 executes them, so every engine
+/// interrupt (alarm pool, DMA) is installed on and serviced by core 1. The
+/// mixer can't be posted this way: tone() returns a voice handle that only
+/// core 1 can pick.
+/// Start it before the first note, with launch() or by calling run() from
+/// your framework's core 1 entry point (e.g. setup1() on arduino-pico).
+/// Only one core 0 context may post at a time.
+class RP2040_Tone_Core1 {
+    public:
+      /// @brief Start core 1 running the engine loop
+      static void launch() {
+        multicore_launch_core1(run);
+      }
+
+      /// @brief The engine loop. Claims core 1's spin lock and alarm, then
+      /// sleeps with __wfe() until there's work; engine interrupts are
+      /// serviced as normal in between. Never returns. Core 0 needs no setup
+      /// first, so it can be called straight from your own core 1 entry
+      /// point, before or after TONE_ON_CORE1 instances are constructed.
+      static void run() {
+        RP2040_Tone_Scheduler::init();
+        _running() = true;
+        for (;;) {
+          tone_command command;
+          while (commands().pop(command)) {
+            command.run(command.target, command);
+          }
+          for (uint core = 0; core < NUM_CORES; core++) {
+            while (isr_commands(core).pop(command)) {
+              command.run(command.target, command);
+            }
+          }
+          __wfe();
+        }
+      }
+
+      /// @brief true once core 1 is in run()
+      static bool running() {
+        return _running();
+      }
+
+      /// @brief Hand a command to core 1
+      /// @return false if the ring is full
+      static bool post(const tone_command &command) {
+        if (!commands().push(command)) {
+          return false;
+        }
+        __sev(); // wake core 1 if it's waiting
+        return true;
+      }
+
+      /// @brief Hand a command to core 1 from an interrupt handler, on either
+      /// core. Each core posts into its own ring, so neither races the other
+      /// or post().
+      /// @return false if the ring is full
+      static bool __not_in_flash_func(post_from_isr)(const tone_command &command) {
+        if (!isr_commands(get_core_num()).push(command)) {
+          return false;
+        }
+        __sev();
+        return true;
+      }
+
+    private:
+      static tone_ring<tone_command, TONE_CORE1_QUEUE_LENGTH> &commands() {
+        static tone_ring<tone_command, TONE_CORE1_QUEUE_LENGTH> s_commands;
+        return s_commands;
+      }
+
+      /// @brief post_from_isr()'s rings, one per posting core
+      static tone_isr_ring &isr_commands(uint core) {
+        static tone_isr_ring s_commands[NUM_CORES];
+        return s_commands[core];
+      }
+
+      static volatile bool &_running() {
+        static volatile bool s_running = false;
+        return s_running;
+      }
+};
+
+/// @brief The TONE_ENGINE_PIO program, loaded once into each PIO block that
+/// has one of its state machines. Every half period the state machine pulls
+/// two words: the number of carrier periods in the half, minus one, then the
+/// carrier word (bits 0-1 pins, 2-16 high time, 17-31 low time, in cycles
+/// less the loop overhead). The carrier loop is 8 cycles plus the two
+/// counts, and each half adds 4 cycles for its pulls.
+class RP2040_Tone_Pio {
+    public:
+      /// @brief Claim a state machine on either PIO block, loading the program
+      /// there first if needed. Panics if none are left, same as running out
+      /// of DMA channels.
+      static void claim(PIO *pio, uint *sm, uint *offset) {
+        PIO blocks[2] = {pio0, pio1};
+        for (int i = 0; i < 2; i++) {
+          int claimed = pio_claim_unused_sm(blocks[i], false);
+          if (claimed < 0) {
+            continue;
+          }
+          int &loaded = _offsets()[i];
+          if (loaded < 0) {
+            if (!pio_can_add_program(blocks[i], &program())) {
+              pio_sm_unclaim(blocks[i], (uint)claimed);
+              continue;
+            }
+            loaded = (int)pio_add_program(blocks[i], &program());
+          }
+          *pio = blocks[i];
+          *sm = (uint)claimed;
+          *offset = (uint)loaded;
+          return;
+        }
+        panic("RP2040_Volume: no free PIO state machine");
+      }
+
+      enum { WRAP = 11 }; // last instruction
+
+    private:
+      //     .wrap_target
+      // 0:  pull block          ; carriers in this half, minus one
+      // 1:  mov x, osr
+      // 2:  pull block          ; carrier word
+      // 3:  mov isr, osr
+      // carrier:
+      // 4:  mov osr, isr
+      // 5:  out pins, 2
+      // 6:  out y, 15
+      // high:
+      // 7:  jmp y-- high
+      // 8:  out y, 15
+      // 9:  set pins, 0
+      // low:
+      // 10: jmp y-- low
+      // 11: jmp x-- carrier
+      //     .wrap
+      static const pio_program &program() {
+        static const uint16_t s_instructions[WRAP + 1] = {
+          0x80a0, 0xa027, 0x80a0, 0xa0c7, 0xa0e6, 0x6002,
+          0x604f, 0x0087, 0x604f, 0xe000, 0x008a, 0x0044,
+        };
+        static const pio_program s_program = {s_instructions, WRAP + 1, -1};
+        return s_program;
+      }
+
+      static int *_offsets() {
+        static int s_offsets[2] = {-1, -1};
+        return s_offsets;
+      }
+};
+
+/// play_pcm() state, only touched by the DMA interrupt while playing
+struct tone_pcm {
+    public:
+      const void *data;        // Next sample, NULL when not playing PCM
+      uint32_t   left;         // Samples left to render
+      bool       wide;         // int16_t samples, otherwise uint8_t
+      int32_t    scale;        // Full-scale level (the volume times _top)
+};
+
+/// begin_stream() ring of CC words. write() is the producer (tail), the DMA
+/// interrupt the consumer (head, in whole blocks).
+struct tone_sink {
+    public:
+      uint32_t  *ring;         // NULL when not streaming
+      volatile uint32_t head;  // First word the DMA may still be reading
+      volatile uint32_t tail;  // Next free word
+      uint32_t   next;         // Next block to hand to the DMA
+      bool       fromRing[2];  // What each channel is set to play
+      int32_t    scale;        // Full-scale level (the volume times _top)
+      volatile uint32_t underruns;
+};
+
+/// NCO engine state, only touched by the DMA interrupt while playing
+struct tone_nco {
+    public:
+      uint32_t   phase;
+      uint32_t   phaseInc;
+      uint32_t   phase2;       // Second tone of a dual tone
+      uint32_t   phaseInc2;
+      uint32_t   samplesLeft;  // Carrier periods left in the current note
+      uint32_t   gapSamples;   // The last samplesLeft are silent
+      uint32_t   ccWords[2];   // Low/high half of the current note
+      uint8_t    drain;        // Blocks since the queue ran dry
+
+      // Wavetable output (set_waveform()), anything but TONE_WAVE_SQUARE
+      // sets the duty cycle from the waveform on every carrier period.
+      uint8_t    wave;
+      const int16_t *table;    // Q15 samples, NULL for the computed triangle
+      uint8_t    tableShift;   // 32 - log2(table length)
+      int32_t    level;        // Level of the current note (after envelope)
+      uint8_t    shiftPlus;    // Bit offset of each pin's level in CC
+      uint8_t    shiftMinus;
+
+      // Envelope and sweep, stepped once per block
+      tone_sweep sweep;
+      tone_envelope envelope;
+      tone_envelope_state envState;
+      int32_t    peak;         // The note's level
+};
+
+class RP2040_Volume{
+    friend class RP2040_Tone_Group;
+
+    public:
+      /// @brief Initialize pins for use in tone generation. In differential
+      /// mode, you must use pins on the same slice of the RP2040 PWM. You can
+      /// initialize as many of these as you like for different pins to drive
+      /// multiple outputs. Will hard fail an assert if pins are not on same
+      /// PWM slice (or, for TONE_ENGINE_PIO, not next to each other).
+      /// @param pin_plus GPIO Pin number for + lead
+      /// @param pin_minus GPIO Pin number for - lead
+      /// @param engine TONE_ENGINE_TIMER, _DMA, _NCO, _MIXER or _PIO,
+      /// optionally OR-ed with TONE_ON_CORE1 (not the mixer, which panics).
+      /// Without it the engine's interrupts run on the core constructing the
+      /// object. The DMA-based engines claim two
+      /// DMA channels for the lifetime of the object (or until
+      /// set_idle_timeout() powers down), the PIO engine one DMA channel and a
+      /// state machine.
+
+      RP2040_Volume(uint8_t pin_plus, uint8_t pin_minus = 255,
+                    uint8_t engine = TONE_ENGINE_TIMER) {
+
+          if (pin_minus != 255) {
+            _diff = true;
+          } else {
+            _diff = false;
+          }
+          
+          _sliceNum = pwm_gpio_to_slice_num(pin_plus);
+          _engine = engine & ~TONE_ON_CORE1;
+          _core1 = (engine & TONE_ON_CORE1) != 0;
+          _core = _core1 ? 1 : (uint8_t)get_core_num();
+          if (_core1 && _engine == TONE_ENGINE_MIXER) {
+            // tone() hands out voices, which core 0 can't know before core
+            // 1 has run the post
+            panic("RP2040_Volume: TONE_ENGINE_MIXER can't run on core 1");
+          }
+
+          if (_engine == TONE_ENGINE_PIO) {
+            init_pio_pins(pin_plus, pin_minus);
+          } else if (_diff) {
+            _pinPlus = pin_plus;
+            _pinMinus = pin_minus;
+
+            assert (pwm_gpio_to_slice_num(_pinMinus) == _sliceNum);
+
+            gpio_set_function(_pinPlus, GPIO_FUNC_PWM);
+            gpio_set_function(_pinMinus, GPIO_FUNC_PWM);
+
+          } else {
+            _pinPlus = pin_plus;
+            _pinMinus = 255;
+            gpio_set_function(_pinPlus, GPIO_FUNC_PWM);
+          }
+
+          // Fixed for the lifetime of the object, tone() only touches the
+          // per-note fields
+          _timerData.cc = &pwm_hw->slice[_sliceNum].cc;
+          _timerData.queue = &_queue;
+          _timerData.active = false;
+          _timerData.idle = &_idleEvent;
+          _idleEvent.callback = idle_cb;
+          _idleEvent.user_data = this;
+          // So cancel() takes the engine core's lock before they're ever
+          // scheduled, rather than core 0's
+          _edge.core = _core;
+          _stopEvent.core = _core;
+          _idleEvent.core = _core;
+#if TONE_STATS
+          _edge.stats = &_stats;
+          _stopEvent.stats = &_stats;
+          _idleEvent.stats = &_stats;
+#endif
+
+          set_carrier(0, TOP);
+
+          claim_dma();
+          _nco.shiftPlus = pwm_gpio_to_channel(_pinPlus) == PWM_CHAN_B ? 16 : 0;
+          _nco.shiftMinus = _diff && pwm_gpio_to_channel(_pinMinus) == PWM_CHAN_B ? 16 : 0;
+          _timerData.shiftPlus = _nco.shiftPlus;
+          _timerData.shiftMinus = _nco.shiftMinus;
+          _timerData.diff = _diff;
+
+          if (stream_engine()) {
+            _streamBuf = RP2040_Tone_Scheduler::claim_stream_buffer();
+          }
+          if (_engine == TONE_ENGINE_MIXER) {
+            _voices = RP2040_Tone_Scheduler::claim_voices();
+          }
+
+          // tone_from_isr() requests run from a software IRQ on this core,
+          // so everything it needs has to be set up from thread context now.
+          if (!_core1) {
+            RP2040_Tone_Scheduler::install_isr_irq();
+            if (stream_engine()) {
+              RP2040_Tone_Scheduler::install_dma_irq();
+            }
+          }
+      }
+
+      /////////////////
+      /// With TONE_ON_CORE1 the teardown is posted to core 1 behind anything
+      /// still queued for this instance, and the destructor waits for it, so
+      /// core 1 never runs a command or an interrupt for a freed object.
+      /// tone_from_isr() posts aren't tracked: stop making them first.
+      ~RP2040_Volume() {
+        if (_core1 && get_core_num() != 1 && RP2040_Tone_Core1::running()) {
+          while (submit(TONE_OP_RELEASE, tone_request()) < 0) {
+            tight_loop_contents(); // ring full, core 1 is draining it
+          }
+          while (_ran != _posted) {
+            __wfe();
+          }
+          return;
+        }
+        release();
+      }
+      /////////////////
+
+      /// @brief Non-blocking tone generation using hardware PWM and timer.
+      /// Starts immediately, replacing the playing note and anything left in
+      /// the queue. Use enqueue_tone() to play notes back to back instead.
+      /// With TONE_ENGINE_MIXER it starts another voice instead, leaving the
+      /// others playing.
+      /// Error in frequency increases with target frequency exponentially,
+      /// becoming approximately ~200 Hz at 20 kHz. Does not allocate: the timer
+      /// state lives in this object.
+      /// @param freq (Hz)
+      /// @param volume (0-100) In steps of 100/resolution percent (0.1 by
+      /// default, see set_carrier())
+      /// @param duration (in units of time)
+      /// @param time Timebase, TIME_MS or TIME_US for specifying duration
+      /// @return Voice handle for stop_voice() (always 0 unless using
+      /// TONE_ENGINE_MIXER), -1 if all voices are busy
+      int8_t tone(float freq, float volume, uint16_t duration, uint8_t time = TIME_MS) {
+        return submit(TONE_OP_PLAY, make_request(freq, volume, duration, time));
+      }
+
+      /// @brief Queue a tone to start as soon as everything before it has
+      /// finished. Starts straight away if nothing is playing. Must be called
+      /// from the same core as the engine's interrupts. Not available with
+      /// TONE_ENGINE_MIXER, where every tone() is its own voice.
+      /// @param freq (Hz)
+      /// @param volume (0-100)
+      /// @param duration (in units of time)
+      /// @param time Timebase, TIME_MS or TIME_US for specifying duration
+      /// @return false if the queue is full (the note is dropped)
+      bool enqueue_tone(float freq, float volume, uint16_t duration, uint8_t time = TIME_MS) {
+        return submit(TONE_OP_ENQUEUE, make_request(freq, volume, duration, time)) >= 0;
+      }
+
+      /// @brief tone() with a 64-bit duration in microseconds, for notes
+      /// longer than tone()'s 65535 ms
+      /// @param freq (Hz)
+      /// @param volume (0-100)
+      /// @param duration_us Duration in microseconds
+      /// @return Voice handle, same as tone()
+      int8_t tone_us(float freq, float volume, uint64_t duration_us) {
+        tone_request request = make_request(freq, volume, 0, TIME_US);
+        request.durationUs = duration_us;
+        return submit(TONE_OP_PLAY, request);
+      }
+
+      /// @brief enqueue_tone() with a 64-bit duration in microseconds
+      /// @return false if the queue is full
+      bool enqueue_tone_us(float freq, float volume, uint64_t duration_us) {
+        tone_request request = make_request(freq, volume, 0, TIME_US);
+        request.durationUs = duration_us;
+        return submit(TONE_OP_ENQUEUE, request) >= 0;
+      }
+
+      /// @brief Integer-only version of tone(), no soft-float on the way in.
+      /// @param freq_mHz Frequency in milli-Hertz (440 Hz = 440000)
+      /// @param level_permille Volume in tenths of a percent (0-1000)
+      /// @param duration_us Duration in microseconds
+      /// @return Voice handle, same as tone()
+      int8_t tone_fixed(uint32_t freq_mHz, uint16_t level_permille, uint64_t duration_us) {
+        return submit(TONE_OP_PLAY, make_request(freq_mHz, freq_to_us(freq_mHz),
+                                                 level_permille, duration_us));
+      }
+
+      /// @brief Integer-only version of enqueue_tone()
+      /// @return false if the queue is full
+      bool enqueue_fixed(uint32_t freq_mHz, uint16_t level_permille, uint64_t duration_us) {
+        return submit(TONE_OP_ENQUEUE, make_request(freq_mHz, freq_to_us(freq_mHz),
+                                                    level_permille, duration_us)) >= 0;
+      }
+
+      /// @brief Play a MIDI note number, the half period comes straight from
+      /// TONE_MIDI_TABLE.
+      /// @param note MIDI note (0-127, 69 = A4 = 440 Hz)
+      /// @param level_permille Volume in tenths of a percent (0-1000)
+      /// @param duration_us Duration in microseconds
+      /// @return Voice handle, same as tone()
+      int8_t tone_midi(uint8_t note, uint16_t level_permille, uint64_t duration_us) {
+        note &= 0x7f;
+        return submit(TONE_OP_PLAY, make_request(TONE_MIDI_TABLE.freq_mHz[note],
+                                                 TONE_MIDI_TABLE.halfPeriodUs[note],
+                                                 level_permille, duration_us));
+      }
+
+      /// @brief Play a chirp from f_start to f_end in one call. The engine
+      /// steps the frequency itself (once per period on the timer engine,
+      /// once per block on the NCO and mixer engines) with precomputed
+      /// fixed-point deltas, so the phase stays continuous and there are no
+      /// gaps. The DMA and PIO engines can't retune mid-note and play
+      /// f_start.
+      /// @param f_start (Hz)
+      /// @param f_end (Hz)
+      /// @param volume (0-100)
+      /// @param duration (in units of time)
+      /// @param curve TONE_SWEEP_LINEAR (constant Hz per second) or
+      /// TONE_SWEEP_EXPONENTIAL (constant octaves per second)
+      /// @param time Timebase, TIME_MS or TIME_US for specifying duration
+      /// @return Voice handle, same as tone()
+      int8_t sweep(float f_start, float f_end, float volume, uint16_t duration,
+                   uint8_t curve = TONE_SWEEP_LINEAR, uint8_t time = TIME_MS) {
+        tone_request request = make_request(f_start, volume, duration, time);
+        request.endFreq_mHz = (uint32_t)(f_end * 1000.0f + 0.5f);
+        request.curve = curve;
+        return submit(TONE_OP_PLAY, request);
+      }
+
+      /// @brief Integer-only version of sweep()
+      /// @param start_mHz Start frequency in milli-Hertz
+      /// @param end_mHz End frequency in milli-Hertz
+      /// @param level_permille Volume in tenths of a percent (0-1000)
+      /// @param duration_us Duration in microseconds
+      /// @param curve TONE_SWEEP_LINEAR or TONE_SWEEP_EXPONENTIAL
+      /// @return Voice handle, same as tone()
+      int8_t sweep_fixed(uint32_t start_mHz, uint32_t end_mHz, uint16_t level_permille,
+                         uint32_t duration_us, uint8_t curve = TONE_SWEEP_LINEAR) {
+        return submit(TONE_OP_PLAY, make_sweep_request(start_mHz, end_mHz, level_permille,
+                                                       duration_us, curve));
+      }
+
+      /// @brief Queue a sweep_fixed()
+      /// @return false if the queue is full
+      bool enqueue_sweep_fixed(uint32_t start_mHz, uint32_t end_mHz, uint16_t level_permille,
+                               uint32_t duration_us, uint8_t curve = TONE_SWEEP_LINEAR) {
+        return submit(TONE_OP_ENQUEUE, make_sweep_request(start_mHz, end_mHz, level_permille,
+                                                          duration_us, curve)) >= 0;
+      }
+
+      /// @brief Play two tones summed into one output, e.g. a DTMF digit,
+      /// from one slice. Each tone has its own phase accumulator and the sum
+      /// is rendered as a sine wave (or the TONE_WAVE_CUSTOM table), each tone
+      /// at half the volume. Needs the NCO or mixer engine: the timer, DMA
+      /// and PIO engines only toggle a square wave.
+      /// @param f1 (Hz)
+      /// @param f2 (Hz)
+      /// @param volume (0-100)
+      /// @param duration (in units of time)
+      /// @param time Timebase, TIME_MS or TIME_US for specifying duration
+      /// @return Voice handle, same as tone(); -1 on the timer, DMA or PIO
+      /// engine
+      int8_t dual_tone(float f1, float f2, float volume, uint16_t duration,
+                       uint8_t time = TIME_MS) {
+        if (!stream_engine()) {
+          return -1;
+        }
+        tone_request request = make_request(f1, volume, duration, time);
+        request.freq2_mHz = (uint32_t)(f2 * 1000.0f + 0.5f);
+        return submit(TONE_OP_PLAY, request);
+      }
+
+      /// @brief Integer-only version of dual_tone()
+      /// @param f1_mHz First frequency in milli-Hertz
+      /// @param f2_mHz Second frequency in milli-Hertz
+      /// @param level_permille Volume in tenths of a percent (0-1000)
+      /// @param duration_us Duration in microseconds
+      /// @return Voice handle, same as tone(); -1 on the timer, DMA or PIO
+      /// engine
+      int8_t dual_tone_fixed(uint32_t f1_mHz, uint32_t f2_mHz, uint16_t level_permille,
+                             uint32_t duration_us) {
+        if (!stream_engine()) {
+          return -1;
+        }
+        return submit(TONE_OP_PLAY, make_dual_request(f1_mHz, f2_mHz, level_permille,
+                                                      duration_us, 0));
+      }
+
+      /// @brief Queue a string of DTMF digits (0-9, *, #, A-D; anything else,
+      /// like spaces or dashes, is skipped). Each digit is one queued note
+      /// with its inter-digit gap rendered as part of the note, so a whole
+      /// number fits in the queue and the engine times the gaps. NCO engine
+      /// only.
+      /// @param digits Zero-terminated string
+      /// @param level_permille Volume in tenths of a percent (0-1000)
+      /// @param tone_us Length of each digit's tones
+      /// @param gap_us Silence after each digit
+      /// @return Digits queued, less than the number of digits in the string
+      /// if the queue filled up
+      int dial(const char *digits, uint16_t level_permille = 1000,
+               uint32_t tone_us = TONE_DTMF_TONE_US, uint32_t gap_us = TONE_DTMF_GAP_US) {
+        if (_engine != TONE_ENGINE_NCO) {
+          return 0;
+        }
+        int queued = 0;
+        for (; *digits != 0; digits++) {
+          int key = TONE_DTMF_TABLE.find(*digits);
+          if (key < 0) {
+            continue;
+          }
+          tone_request request = make_dual_request(TONE_DTMF_TABLE.low_mHz[key],
+                                                   TONE_DTMF_TABLE.high_mHz[key],
+                                                   level_permille, tone_us, gap_us);
+          if (submit(TONE_OP_ENQUEUE, request) < 0) {
+            break;
+          }
+          queued++;
+        }
+        return queued;
+      }
+
+      /// @brief Queue a MIDI note number
+      /// @return false if the queue is full
+      bool enqueue_midi(uint8_t note, uint16_t level_permille, uint64_t duration_us) {
+        note &= 0x7f;
+        return submit(TONE_OP_ENQUEUE, make_request(TONE_MIDI_TABLE.freq_mHz[note],
+                                                    TONE_MIDI_TABLE.halfPeriodUs[note],
+                                                    level_permille, duration_us)) >= 0;
+      }
+
+      /// @brief Select the waveform for the NCO engine (the other engines only
+      /// play square waves). Square, sine and custom tables are peak-scaled
+      /// by the note's volume. Single-ended outputs swing around half the
+      /// volume, differential outputs drive + for the positive half of the
+      /// wave and - for the negative half, like the square wave does. Change
+      /// it while nothing is playing.
+      /// @param waveform TONE_WAVE_SQUARE, _SINE, _TRIANGLE or _CUSTOM
+      /// @param table For TONE_WAVE_CUSTOM: one period of Q15 samples
+      /// (-32767..32767). Read in place, so it can live in flash.
+      /// @param table_bits For TONE_WAVE_CUSTOM: log2 of the table length
+      /// (1-16)
+      void set_waveform(uint8_t waveform, const int16_t *table = NULL,
+                        uint8_t table_bits = 0) {
+        switch (waveform) {
+          case TONE_WAVE_SINE:
+            _nco.table = TONE_SINE_TABLE.value;
+            _nco.tableShift = 32 - 8;
+            break;
+          case TONE_WAVE_CUSTOM:
+            assert(table != NULL && table_bits >= 1 && table_bits <= 16);
+            _nco.table = table;
+            _nco.tableShift = 32 - table_bits;
+            break;
+          default:
+            _nco.table = NULL;
+            break;
+        }
+        _nco.wave = waveform;
+      }
+
+      /// @brief Configure the ultrasonic carrier. The divider is worked out
+      /// from clock_get_hz(clk_sys), so the carrier is right on overclocked
+      /// (or underclocked) parts. Call while nothing is playing: it takes
+      /// effect from the next note.
+      /// @param carrier_hz Target carrier frequency, 0 for the fastest the
+      /// resolution allows (divider of 1)
+      /// @param resolution Volume steps, which is the slice's TOP (1-65534).
+      /// The carrier can't exceed clk_sys / (2 * (resolution + 1)), or
+      /// clk_sys / (resolution + 1) without phase correction. The PIO engine
+      /// runs its carrier from the same numbers, but its counters are 15
+      /// bits: keep the carrier between 16 and 32775 cycles (e.g. resolution
+      /// 7-16386 with phase correction).
+      /// @param phase_correct Phase correct (centre aligned) PWM, which
+      /// halves the carrier for a given resolution
+      /// @return The carrier actually achieved, in milli-Hertz. Faster
+      /// settings are slowed to fit, at most ~4.29 MHz.
+      uint32_t set_carrier(uint32_t carrier_hz, uint16_t resolution = TOP,
+                           bool phase_correct = true) {
+        if (resolution < 1) {
+          resolution = 1;
+        } else if (resolution > 65534) {
+          resolution = 65534;
+        }
+        // Phase correct mode counts up then down, so one wrap per 2*(TOP+1)
+        uint64_t cyclesPerWrap = (uint64_t)(resolution + 1) * (phase_correct ? 2 : 1);
+        uint64_t sysHz = clock_get_hz(clk_sys);
+
+        // Divider in 8.4 fixed point, 1.0 to 255 15/16
+        uint64_t div16 = 16;
+        if (carrier_hz > 0) {
+          div16 = (sysHz * 16 + carrier_hz * cyclesPerWrap / 2) /
+                  (carrier_hz * cyclesPerWrap);
+        }
+        // The carrier is kept in milli-Hertz in 32 bits, so at most ~4.29 MHz
+        uint64_t minDiv16 = (sysHz * 16000 + cyclesPerWrap * 0xffffffffull - 1) /
+                            (cyclesPerWrap * 0xffffffffull);
+        if (div16 < 16) {
+          div16 = 16;
+        } else if (div16 > 0xfff) {
+          div16 = 0xfff;
+        }
+        if (div16 < minDiv16) {
+          div16 = minDiv16;
+        }
+
+        _top = resolution;
+        _clkdiv16 = (uint16_t)div16;
+        _phaseCorrect = phase_correct;
+        _carrierMilliHz = (uint32_t)(sysHz * 16000 / (div16 * cyclesPerWrap));
+
+        // NCO step per milli-Hertz (Q16) and carrier periods per us (Q32)
+        _ncoIncScale = (uint32_t)(((uint64_t)1 << 48) / _carrierMilliHz);
+        _ncoSamplesPerUs = ((uint64_t)_carrierMilliHz << 32) / 1000000000u;
+        _blockUs = (uint32_t)((uint64_t)TONE_STREAM_BLOCK * 1000000000u / _carrierMilliHz);
+        return _carrierMilliHz;
+      }
+
+      /// @brief Choose how the timer engine ends notes. By default it counts
+      /// edges, so a note lasts a whole number of half periods (the duration
+      /// is rounded down to one). With deadline timing the end of each note
+      /// is an absolute deadline on the shared scheduler, measured from when
+      /// the previous one was due: the edge interrupt only flips the level,
+      /// the last half period is cut short to land on the deadline, and long
+      /// 64-bit notes stay exact to the microsecond. Queued notes then start
+      /// on their deadline rather than on an edge. The other engines already
+      /// end notes on deadlines (DMA, PIO) or exact carrier counts (NCO,
+      /// mixer). Call while nothing is playing.
+      void set_deadline_timing(bool on) {
+        _timerData.deadline = on;
+      }
+
+      /// @brief Shape every note made after this call with an ADSR envelope,
+      /// so notes fade in and out instead of clicking. The engine steps it in
+      /// integer Q16 from its own interrupt (once per period of the tone on
+      /// the timer engine, once per block on the NCO and mixer engines), so
+      /// a single tone() gives the whole shape. The release happens inside
+      /// the note's duration, so queued notes keep their timing. The DMA
+      /// engine plays notes flat.
+      /// @param attack_us Rise from silence to the note's level
+      /// @param decay_us Fall from there to the sustain level
+      /// @param sustain_permille Sustain level, in tenths of a percent of the
+      /// note's level (0-1000)
+      /// @param release_us Fall from the sustain level to silence at the end
+      /// of the note
+      void set_envelope(uint32_t attack_us, uint32_t decay_us,
+                        uint16_t sustain_permille, uint32_t release_us) {
+        if (sustain_permille > 1000) {
+          sustain_permille = 1000;
+        }
+        _adsr.attackUs = attack_us;
+        _adsr.decayUs = decay_us;
+        _adsr.sustain = ((uint32_t)sustain_permille << 16) / 1000;
+        _adsr.releaseUs = release_us;
+        _adsr.on = attack_us != 0 || release_us != 0 || sustain_permille != 1000;
+      }
+
+      /// @brief Go back to flat notes
+      void clear_envelope() {
+        set_envelope(0, 0, 1000, 0);
+      }
+
+      /// @brief Play 16-bit signed PCM through the NCO or mixer engine's DMA
+      /// pair, replacing whatever is playing. Samples are read in place, so
+      /// the data can stay in flash (XIP) with no copy. Each block is scaled
+      /// to CC words from the DMA interrupt, and a DMA timer paces them into
+      /// the slice at sample_rate. Keep the rate between clk_sys / 65535
+      /// (~1.9 kHz) and the carrier (62.5 kHz by default). Single-ended outputs swing around half the volume,
+      /// differential outputs drive + and - like the wavetables do. Not
+      /// posted to core 1: call it from the core that runs the engine.
+      /// @param data Samples, -32768..32767
+      /// @param n Number of samples
+      /// @param sample_rate Samples per second
+      /// @param level_permille Volume in tenths of a percent (0-1000)
+      /// @return false if this engine can't play PCM
+      bool play_pcm(const int16_t *data, size_t n, uint32_t sample_rate,
+                    uint16_t level_permille = 1000) {
+        return start_pcm(data, true, n, sample_rate, level_permille);
+      }
+
+      /// @brief Play 8-bit unsigned PCM (128 is silence, as in 8-bit WAV
+      /// files), see the int16_t version
+      bool play_pcm(const uint8_t *data, size_t n, uint32_t sample_rate,
+                    uint16_t level_permille = 1000) {
+        return start_pcm(data, false, n, sample_rate, level_permille);
+      }
+
+      /// @brief Start streaming live 16-bit audio through the NCO or mixer
+      /// engine's DMA pair, replacing whatever is playing. Feed it with
+      /// write(); until enough arrives (or whenever it runs dry) the output
+      /// idles at silence and stream_underruns() counts the blocks missed.
+      /// Runs until end_stream() or the next tone(). Not posted to core 1:
+      /// call it from the core that runs the engine.
+      /// @param sample_rate Samples per second, as for play_pcm()
+      /// @param level_permille Volume in tenths of a percent (0-1000)
+      /// @return false if this engine can't stream or no ring is left
+      /// (TONE_SINK_RINGS)
+      bool begin_stream(uint32_t sample_rate, uint16_t level_permille = 1000) {
+        if (!stream_engine() || sample_rate == 0) {
+          return false;
+        }
+        // As start_pcm(), tone_from_isr() waits until the sink is running
+        RP2040_Tone_Scheduler::hold_isr_commands(true);
+        stop_now();
+        uint32_t *ring = RP2040_Tone_Scheduler::claim_sink_ring();
+        if (ring == NULL) {
+          RP2040_Tone_Scheduler::hold_isr_commands(false);
+          return false;
+        }
+        if (level_permille > 1000) {
+          level_permille = 1000;
+        }
+        if (_pcmTimer < 0) {
+          _pcmTimer = dma_claim_unused_timer(true);
+        }
+        set_pcm_rate(sample_rate);
+
+        _sink.head = 0;
+        _sink.tail = 0;
+        _sink.next = 0;
+        _sink.underruns = 0;
+        _sink.scale = (int32_t)((uint32_t)level_permille * _top / 1000);
+        _sink.ring = ring;
+        start_sink();
+        RP2040_Tone_Scheduler::hold_isr_commands(false);
+        return true;
+      }
+
+      /// @brief Push samples into the stream. Never blocks: takes as many as
+      /// fit. Safe from one producer at a time, on either core or in an
+      /// interrupt.
+      /// @param samples -32768..32767
+      /// @param n Number of samples
+      /// @return Number of samples accepted
+      size_t __not_in_flash_func(write)(const int16_t *samples, size_t n) {
+        uint32_t *ring = _sink.ring;
+        if (ring == NULL) {
+          return 0;
+        }
+        size_t count = available();
+        if (count > n) {
+          count = n;
+        }
+        uint32_t tail = _sink.tail;
+        for (size_t i = 0; i < count; i++) {
+          ring[tail] = pcm_word(samples[i], _sink.scale);
+          if (++tail == TONE_SINK_BLOCKS * TONE_STREAM_BLOCK) {
+            tail = 0;
+          }
+        }
+        __dmb(); // words must be visible before the DMA interrupt sees them
+        _sink.tail = tail;
+        return count;
+      }
+
+      /// @brief Samples write() would accept right now
+      size_t available() const {
+        if (_sink.ring == NULL) {
+          return 0;
+        }
+        const uint32_t size = TONE_SINK_BLOCKS * TONE_STREAM_BLOCK;
+        return (_sink.head + size - _sink.tail - 1) % size;
+      }
+
+      /// @brief Blocks of silence played because write() fell behind
+      uint32_t stream_underruns() const {
+        return _sink.underruns;
+      }
+
+      /// @brief Stop streaming and park the outputs low
+      void end_stream() {
+        RP2040_Tone_Scheduler::hold_isr_commands(true);
+        stop_now();
+        RP2040_Tone_Scheduler::hold_isr_commands(false);
+      }
+
+      /// @brief Queue a silence of the given length.
+      /// @param duration (in units of time)
+      /// @param time Timebase, TIME_MS or TIME_US for specifying duration
+      /// @return false if the queue is full
+      bool enqueue_rest(uint16_t duration, uint8_t time = TIME_MS) {
+        uint32_t us = time == TIME_US ? duration : (uint32_t)1000*duration;
+        return submit(TONE_OP_ENQUEUE, make_request((uint32_t)0, 0, 0, us)) >= 0;
+      }
+
+      /// @brief Play a tone_patch, replacing whatever is playing: the first
+      /// note starts now and the rest are queued behind it. The patch isn't
+      /// copied, so it must outlive the sound (a static constexpr is ideal).
+      /// Every engine with a queue can play patches, so not the mixer.
+      /// @return false on the mixer engine
+      bool play(const tone_patch &patch) {
+        return submit(TONE_OP_PATCH, tone_request(), 0, &patch) >= 0;
+      }
+
+      /// @brief Wait-free tone_fixed() for interrupt handlers (GPIO, timer,
+      /// UART...). A tone_command (64 bytes on the RP2040) is built on the
+      /// stack and copied into a lock-free ring, about 40 word stores in
+      /// all, with no locks and no division. The path runs from RAM except
+      /// irq_set_pending(), the SDK's one NVIC store, which is in flash and
+      /// can cost an XIP fetch. The software IRQ on the engine's core, or
+      /// core 1 for TONE_ON_CORE1, plays it as soon as the calling handler
+      /// returns. Call from one interrupt priority level per
+      /// core: handlers that can preempt each other would be two producers.
+      /// TONE_ON_CORE1 instances take requests from either core, others only
+      /// from handlers on the core that runs the engine (false otherwise).
+      /// @param freq_mHz Frequency in milli-Hertz (440 Hz = 440000)
+      /// @param level_permille Volume in tenths of a percent (0-1000)
+      /// @param duration_us Duration in microseconds
+      /// @return false if the ring is full (the request is dropped)
+      bool __not_in_flash_func(tone_from_isr)(uint32_t freq_mHz, uint16_t level_permille,
+                                              uint32_t duration_us) {
+        // usPerWave of 0: the divide is left to make_note()
+        return post_from_isr(TONE_OP_PLAY,
+                             make_request(freq_mHz, 0, level_permille, duration_us));
+      }
+
+      /// @brief Wait-free enqueue_fixed() for interrupt handlers, see
+      /// tone_from_isr()
+      /// @return false if the ring is full
+      bool __not_in_flash_func(enqueue_from_isr)(uint32_t freq_mHz, uint16_t level_permille,
+                                                 uint32_t duration_us) {
+        return post_from_isr(TONE_OP_ENQUEUE,
+                             make_request(freq_mHz, 0, level_permille, duration_us));
+      }
+
+      /// @brief Wait-free stop_tone() for interrupt handlers, see
+      /// tone_from_isr()
+      /// @return false if the ring is full
+      bool __not_in_flash_func(stop_from_isr)() {
+        return post_from_isr(TONE_OP_STOP, tone_request());
+      }
+
+      /// @brief Stop a single mixer voice, the others keep playing. Takes
+      /// effect from the next DMA block.
+      /// @param voice Handle returned by tone()
+      void stop_voice(int8_t voice) {
+        submit(TONE_OP_STOP_VOICE, tone_request(), voice);
+      }
+
+      /// @brief Turns off the timer, drops queued notes and puts PWM pins low
+      void stop_tone() {
+        submit(TONE_OP_STOP, tone_request());
+      }
+
+      /// @brief Whether anything is playing or queued, including calls still
+      /// on their way to core 1
+      bool is_playing() const {
+        return _timerData.active || _posted != _ran;
+      }
+
+      /// @brief Sleep the calling core (__wfe()) until the last queued note
+      /// has finished or stop_tone() runs. Every engine signals the end of
+      /// each note, so this wakes at most once per note and interrupt. Not
+      /// from an interrupt handler, and not on core 1 for TONE_ON_CORE1.
+      void wait_done() const {
+        while (is_playing()) {
+          __wfe();
+        }
+      }
+
+      /// @brief Have callback(user_data, last) run at the end of every note,
+      /// last being true once the queue has run dry. It runs in the interrupt
+      /// that ended the note (timer engine edges with the scheduler's lock
+      /// held), so keep it short and use tone_from_isr() and friends to start
+      /// something new; stop_tone() doesn't call it. NCO and mixer notes are
+      /// rendered ahead, so they report up to a block early.
+      /// @param callback NULL to turn it off
+      void set_done_callback(tone_done_callback_t callback, void *user_data = NULL) {
+        uint32_t save = save_and_disable_interrupts();
+        _timerData.done = NULL; // never a callback with the wrong user_data
+        _timerData.doneData = user_data;
+        _timerData.done = callback;
+        restore_interrupts(save);
+      }
+
+      /// @brief Power down once the output has been quiet for quiet_ms: the
+      /// slice is disabled with its pins driven low as plain GPIOs (the PIO
+      /// engine's state machine is already stopped) and the DMA channels and
+      /// DMA timer go back to the pool. The shared alarm isn't re-armed once
+      /// nothing is scheduled, so a quiet process takes no interrupts. The
+      /// next note claims everything back before it starts, see wake_us().
+      /// @param quiet_ms 0 (the default) to keep everything claimed
+      void set_idle_timeout(uint32_t quiet_ms) {
+        RP2040_Tone_Scheduler::cancel(&_idleEvent);
+        _timerData.idleUs = quiet_ms > UINT32_MAX / 1000 ? UINT32_MAX : quiet_ms * 1000;
+        if (!is_playing()) {
+          arm_idle();
+        }
+      }
+
+      /// @brief Whether set_idle_timeout() has powered the output down
+      bool is_asleep() const {
+        return _asleep;
+      }
+
+      /// @brief How long the last wake from set_idle_timeout() took, in
+      /// microseconds: re-claiming the DMA channels and handing the pins back
+      /// to the slice, added to the start of that note
+      uint32_t wake_us() const {
+        return _wakeUs;
+      }
+
+      /// @brief This instance's share of RP2040_Tone_Scheduler::get_stats():
+      /// its alarm callbacks and DMA block interrupts. Zeros unless built
+      /// with TONE_STATS.
+      tone_stats get_stats() const {
+#if TONE_STATS
+        return RP2040_Tone_Scheduler::read_stats(&_stats, _core);
+#else
+        return tone_stats();
+#endif
+      }
+
+      /// @brief Start get_stats() over from now
+      void reset_stats() {
+#if TONE_STATS
+        RP2040_Tone_Scheduler::clear_stats(&_stats, _core);
+#endif
+      }
+
+      /// @brief Retune the note that's playing, phase continuous and without
+      /// touching the slice: the new pitch starts on the next edge (timer),
+      /// half period (DMA, PIO) or block (NCO, mixer). The note keeps its end
+      /// time and any sweep on it stops. Queued notes are unaffected.
+      /// @param freq (Hz)
+      /// @param voice Mixer voice handle, ignored by the other engines
+      /// @return false if nothing is playing
+      bool set_frequency(float freq, int8_t voice = 0) {
+        return set_frequency_fixed((uint32_t)(freq * 1000.0f + 0.5f), voice);
+      }
+
+      /// @brief Integer-only version of set_frequency()
+      /// @param freq_mHz Frequency in milli-Hertz
+      bool set_frequency_fixed(uint32_t freq_mHz, int8_t voice = 0) {
+        if (freq_mHz == 0) {
+          return false;
+        }
+        return submit(TONE_OP_SET_FREQUENCY,
+                      make_request(freq_mHz, freq_to_us(freq_mHz), 0, 0), voice) >= 0;
+      }
+
+      /// @brief Change the volume of the note that's playing from its next
+      /// edge, half period or block. With an envelope it sets the peak the
+      /// envelope is scaled by.
+      /// @param volume (0-100)
+      /// @param voice Mixer voice handle, ignored by the other engines
+      /// @return false if nothing is playing
+      bool set_volume(float volume, int8_t voice = 0) {
+        tone_request request = make_request(0.0f, volume, 0, TIME_US);
+        return submit(TONE_OP_SET_VOLUME, request, voice) >= 0;
+      }
+
+      /// @brief Integer-only version of set_volume()
+      /// @param level_permille Volume in tenths of a percent (0-1000)
+      bool set_volume_fixed(uint16_t level_permille, int8_t voice = 0) {
+        return submit(TONE_OP_SET_VOLUME,
+                      make_request((uint32_t)0, 0, level_permille, 0), voice) >= 0;
+      }
+
+    protected:
+      uint16_t            _level;
+      uint8_t             _pinPlus;
+      uint8_t             _pinMinus;
+      uint8_t             _sliceNum;
+      bool                _diff = false;
+
+      struct timer_data   _timerData = timer_data();
+      tone_queue          _queue;
+      struct tone_event   _stopEvent = tone_event(); // DMA engine end of note
+      struct tone_event   _edge = tone_event();      // Timer engine edges
+      struct tone_event   _idleEvent = tone_event(); // set_idle_timeout()
+      bool                _asleep = false; // powered down, see idle_cb()
+#if TONE_STATS
+      struct tone_stats   _stats;          // get_stats()
+#endif
+      uint32_t            _wakeUs = 0;     // What the last wake() took
+      // Per-edge callback, RP2040_VolumeT swaps in one specialised for its pins
+      tone_event_callback_t _timerCb = timer_cb;
+
+      uint32_t            _carrierMilliHz; // PWM wrap rate
+      uint16_t            _top = TOP;      // Full volume, see set_carrier()
+      uint16_t            _clkdiv16 = 16;  // Slice divider, 8.4 fixed point
+      bool                _phaseCorrect = true;
+      uint32_t            _blockUs;        // Length of one stream block
+      struct tone_adsr    _adsr = tone_adsr();
+
+      uint8_t             _engine = TONE_ENGINE_TIMER;
+      bool                _core1 = false; // calls from core 0 are posted
+      uint8_t             _core = 0;      // takes the engine's interrupts
+      // Commands posted to core 1 and run there, one writer each
+      volatile uint32_t   _posted = 0;
+      volatile uint32_t   _ran = 0;
+      // DMA engine: [0] copies CC words into the slice, [1] re-points [0]
+      // every half period. NCO engine: ping-pong pair, one per stream block.
+      int                 _dma[2] = {-1, -1};
+      // CC register words for each half of the wave, in two pairs so a
+      // queued note can be written while the other plays: [n][0] is the
+      // "low" half (+ at 0) that every tone starts on, [n][1] is the "high"
+      // half. _ccPair is the one _ccWordAddrs points at.
+      uint32_t            _ccWords[2][2] = {{0, 0}, {0, 0}};
+      uint8_t             _ccPair = 0;
+      // Read by _dma[1] through an 8-byte read ring, so it must stay aligned
+      alignas(8) const uint32_t *_ccWordAddrs[2] = {&_ccWords[0][0], &_ccWords[0][1]};
+
+      // PIO engine: the state machine and the half period words _dma[0]
+      // loops into its TX FIFO (length minus one, carrier word, for the low
+      // then the high half) through a 16-byte read ring.
+      PIO                 _pio = NULL;
+      uint                _pioSm = 0;
+      uint                _pioOffset = 0;
+      uint8_t             _pioBase;        // Lowest of our pins
+      uint8_t             _pioCount;       // 1, or 2 for differential
+      uint8_t             _pioPlus;        // Each pin's bit in the carrier word
+      uint8_t             _pioMinus;
+      alignas(16) uint32_t _pioWords[4] = {0, 0, 0, 0};
+
+      uint32_t            _ncoIncScale;     // 2^48 / carrier (mHz)
+      uint64_t            _ncoSamplesPerUs; // carrier (MHz) in Q32, over 1.0 from 1 MHz
+      struct tone_nco     _nco = tone_nco();
+      tone_voice         *_voices = NULL;    // TONE_MAX_VOICES, mixer engine only
+      uint32_t           *_streamBuf = NULL; // 2 blocks, one per _dma channel
+      struct tone_pcm     _pcm = tone_pcm();
+      struct tone_sink    _sink = tone_sink();
+      int                 _pcmTimer = -1;     // DMA timer, claimed by play_pcm()
+
+      
+      /// @brief Frequency to microsecond conversion for how often the PWM
+      /// inputs need to be switched to generate an appropriate wave.
+      /// @param freq_mHz (milli-Hertz)
+      /// @return uint32_t microseconds per half period (rounded, at least 1)
+      uint32_t freq_to_us(uint32_t freq_mHz) {
+        if (freq_mHz == 0) {
+          return 1; // a rest, see make_note()
+        }
+        // 1e6 us / (2 * freq) as we switch every half-cycle
+        uint32_t us = (500000000u + freq_mHz/2) / freq_mHz;
+        return us > 0 ? us : 1;
+      }
+
+      enum {
+        TONE_OP_PLAY,
+        TONE_OP_ENQUEUE,
+        TONE_OP_STOP,
+        TONE_OP_STOP_VOICE,
+        TONE_OP_PATCH,
+        TONE_OP_SET_FREQUENCY,
+        TONE_OP_SET_VOLUME,
+        TONE_OP_RELEASE,
+      };
+
+      /// @brief Does the only float math on the float API, so everything
+      /// after this is integer.
+      tone_request make_request(float freq, float volume, uint16_t duration, uint8_t time) {
+        if (volume > 100) {
+          volume = 100;
+        }
+
+        if (volume < 0) {
+          volume = 0;
+        }
+
+        uint32_t freq_mHz = (uint32_t)(freq * 1000.0f + 0.5f);
+        tone_request request = make_request(freq_mHz, freq_to_us(freq_mHz), 0,
+                                            time == TIME_US ? duration : (uint32_t)1000*duration);
+        // Kept finer than per mille, for resolutions above 1000
+        request.level = (uint32_t)(volume * 655.36f + 0.5f);
+        return request;
+      }
+
+      tone_request __not_in_flash_func(make_request)(uint32_t freq_mHz, uint32_t usPerWave,
+                                                     uint16_t level_permille,
+                                                     uint64_t duration_us) {
+        tone_request request;
+        request.freq_mHz = freq_mHz;
+        request.usPerWave = usPerWave;
+        if (level_permille > 1000) {
+          level_permille = 1000;
+        }
+        // (level_permille << 16) / 1000 without a divide, as tone_from_isr()
+        // comes through here: 65.536 = 65 + 70255 / 2^17, exact for 0-1000
+        request.level = (uint32_t)level_permille * 65 +
+                        (((uint32_t)level_permille * 70255) >> 17);
+        request.durationUs = duration_us;
+        request.endFreq_mHz = 0;
+        request.curve = TONE_SWEEP_LINEAR;
+        request.freq2_mHz = 0;
+        request.gapUs = 0;
+        return request;
+      }
+
+      tone_request make_dual_request(uint32_t f1_mHz, uint32_t f2_mHz,
+                                     uint16_t level_permille, uint32_t duration_us,
+                                     uint32_t gap_us) {
+        tone_request request = make_request(f1_mHz, freq_to_us(f1_mHz),
+                                            level_permille, duration_us);
+        request.freq2_mHz = f2_mHz;
+        request.gapUs = gap_us;
+        return request;
+      }
+
+      tone_request make_sweep_request(uint32_t start_mHz, uint32_t end_mHz,
+                                      uint16_t level_permille, uint32_t duration_us,
+                                      uint8_t curve) {
+        tone_request request = make_request(start_mHz, freq_to_us(start_mHz),
+                                            level_permille, duration_us);
+        request.endFreq_mHz = end_mHz;
+        request.curve = curve;
+        return request;
+      }
+
+      /// @brief Run a call here, or post it to core 1 if that's where this
+      /// instance's engine lives.
+      /// @return Voice handle (or 0) for plays, 0 for anything else that
+      /// succeeded, -1 on failure. Posted calls can't know the voice and
+      /// return 0.
+      int8_t submit(uint8_t op, const tone_request &request, int8_t voice = 0,
+                    const tone_patch *patch = NULL) {
+        if (_core1 && get_core_num() != 1) {
+          tone_command command;
+          command.run = run_posted;
+          command.target = this;
+          command.op = op;
+          command.voice = voice;
+          command.request = request;
+          command.patch = patch;
+          // Counted before core 1 can see it, so is_playing() doesn't miss a
+          // note that hasn't started yet
+          _posted++;
+          if (!RP2040_Tone_Core1::post(command)) {
+            _posted--;
+            return -1;
+          }
+          return 0;
+        }
+        if (_core1) {
+          return execute(op, request, voice, patch); // core 1 only runs one at a time
+        }
+        RP2040_Tone_Scheduler::hold_isr_commands(true);
+        int8_t result = execute(op, request, voice, patch);
+        RP2040_Tone_Scheduler::hold_isr_commands(false);
+        return result;
+      }
+
+      /// @brief submit() for interrupt handlers: never runs anything here
+      bool __not_in_flash_func(post_from_isr)(uint8_t op, const tone_request &request) {
+        tone_command command;
+        command.run = run_command;
+        command.target = this;
+        command.op = op;
+        command.voice = 0;
+        command.request = request;
+        command.patch = NULL;
+        if (_core1) {
+          return RP2040_Tone_Core1::post_from_isr(command);
+        }
+        return RP2040_Tone_Scheduler::post_from_isr(command, _core);
+      }
+
+      static void run_command(void *target, const tone_command &command) {
+        ((RP2040_Volume*)target)->execute(command.op, command.request,
+                                          command.voice, command.patch);
+      }
+
+      /// @brief run_command() for submit()'s posts: marks it done for
+      /// is_playing()
+      static void run_posted(void *target, const tone_command &command) {
+        RP2040_Volume *self = (RP2040_Volume*)target;
+        run_command(target, command);
+        self->_ran++;
+        __sev();
+      }
+
+      int8_t execute(uint8_t op, const tone_request &request, int8_t voice,
+                     const tone_patch *patch = NULL) {
+        switch (op) {
+          case TONE_OP_PLAY:
+            return play(make_note(request));
+          case TONE_OP_ENQUEUE:
+            return enqueue(make_note(request)) ? 0 : -1;
+          case TONE_OP_STOP_VOICE:
+            if (_engine == TONE_ENGINE_MIXER) {
+              if (voice >= 0 && voice < TONE_MAX_VOICES) {
+                _voices[voice].active = false;
+              }
+              return 0;
+            }
+            stop_now();
+            return 0;
+          case TONE_OP_STOP:
+            stop_now();
+            return 0;
+          case TONE_OP_PATCH:
+            return play_patch(*patch);
+          case TONE_OP_SET_FREQUENCY:
+          case TONE_OP_SET_VOLUME: {
+            // Runs on the engine's core, so keeping its interrupts out makes
+            // the handful of stores atomic
+            uint32_t save = save_and_disable_interrupts();
+            bool done = op == TONE_OP_SET_FREQUENCY ? retune(request, voice)
+                                                    : revolume(request.level, voice);
+            restore_interrupts(save);
+            return done ? 0 : -1;
+          }
+          case TONE_OP_RELEASE:
+            release();
+            return 0;
+        }
+        return -1;
+      }
+
+      /// @brief set_frequency() on whatever the engine is playing
+      bool retune(const tone_request &request, int8_t voice) {
+        if (!_timerData.active) {
+          return false;
+        }
+        uint32_t phaseInc = (uint32_t)(((uint64_t)request.freq_mHz * _ncoIncScale) >> 16);
+        switch (_engine) {
+          case TONE_ENGINE_TIMER: {
+            uint32_t oldUs = (uint32_t)_edge.delay_us;
+            if (!_timerData.deadline) {
+              // Keep the end time: the next edge is already due at the old
+              // half period, the rest at the new one
+              uint64_t left = (uint64_t)(_timerData.numRepeats - _timerData.repeats - 1) * oldUs;
+              uint32_t edges = clamp_us((left + request.usPerWave / 2) / request.usPerWave);
+              _timerData.numRepeats = _timerData.repeats + 1 + edges;
+            }
+            _timerData.sweep.on = false;
+            _edge.delay_us = request.usPerWave; // from the next edge on
+            return true;
+          }
+          case TONE_ENGINE_DMA:
+            // Reloaded the next time _dma[1] restarts _dma[0]
+            dma_hw->ch[_dma[0]].transfer_count = freq_to_carriers(request.freq_mHz);
+            return true;
+          case TONE_ENGINE_PIO:
+            _pioWords[0] = freq_to_carriers(request.freq_mHz) - 1;
+            _pioWords[2] = _pioWords[0];
+            return true;
+          case TONE_ENGINE_NCO:
+            _nco.sweep.on = false;
+            _nco.phaseInc = phaseInc;
+            return true;
+          case TONE_ENGINE_MIXER:
+            if (voice < 0 || voice >= TONE_MAX_VOICES || !_voices[voice].active) {
+              return false;
+            }
+            _voices[voice].sweep.on = false;
+            _voices[voice].phaseInc = phaseInc;
+            return true;
+        }
+        return false;
+      }
+
+      /// @brief set_volume() on whatever the engine is playing
+      /// @param level Fraction of full volume, 65536 = 100%
+      bool revolume(uint32_t level, int8_t voice) {
+        if (!_timerData.active) {
+          return false;
+        }
+        if (level > 65536) {
+          level = 65536;
+        }
+        uint16_t top = (uint16_t)(((uint64_t)level * _top + 32768) >> 16);
+        switch (_engine) {
+          case TONE_ENGINE_TIMER:
+            _timerData.peak = top;
+            if (!_timerData.envelope.on) {
+              fill_cc_words(top, _timerData.ccWords); // written on the next edge
+            }
+            break;
+          case TONE_ENGINE_DMA:
+            fill_cc_words(top, _ccWords[_ccPair]);
+            break;
+          case TONE_ENGINE_PIO: {
+            uint32_t words[2];
+            fill_pio_words(top, words);
+            _pioWords[1] = words[0];
+            _pioWords[3] = words[1];
+            break;
+          }
+          case TONE_ENGINE_NCO:
+            _nco.peak = top;
+            if (!_nco.envelope.on) {
+              _nco.level = top;
+              fill_cc_words(top, _nco.ccWords);
+            }
+            break;
+          case TONE_ENGINE_MIXER: {
+            if (voice < 0 || voice >= TONE_MAX_VOICES || !_voices[voice].active) {
+              return false;
+            }
+            tone_voice *v = &_voices[voice];
+            v->peak = top;
+            if (!v->envelope.on) {
+              v->level = top;
+            }
+            return true;
+          }
+        }
+        _level = top;
+        return true;
+      }
+
+      int8_t play_patch(const tone_patch &patch) {
+        if (_engine == TONE_ENGINE_MIXER) {
+          return -1;
+        }
+        // The patch's envelope only applies to its own notes
+        tone_adsr adsr = _adsr;
+        if (patch.adsr.on) {
+          _adsr = patch.adsr;
+        }
+        stop_now();
+        for (uint8_t i = 0; i < patch.length; i++) {
+          enqueue(make_note(patch.steps[i])); // the first one starts the engine
+        }
+        _adsr = adsr;
+        return 0;
+      }
+
+      void stop_now() {
+        halt_engine();
+        _queue.clear();
+        for (int v = 0; _voices != NULL && v < TONE_MAX_VOICES; v++) {
+          _voices[v].active = false;
+        }
+
+        // Set PWMs to low
+        if (_engine == TONE_ENGINE_PIO) {
+          park_pio();
+        } else {
+          *_timerData.cc = 0;
+        }
+        arm_idle();
+      }
+
+      /// @brief The destructor's work, on the engine's core: stop everything
+      /// and give back the hardware and buffers
+      void release() {
+        // Events first: once cancelled their callbacks can't run, so nothing
+        // touches the hardware below while it is being released.
+        RP2040_Tone_Scheduler::cancel(&_edge);
+        RP2040_Tone_Scheduler::cancel(&_stopEvent);
+        RP2040_Tone_Scheduler::cancel(&_idleEvent);
+        if (_dma[0] >= 0) {
+          abort_dma();
+          RP2040_Tone_Scheduler::set_dma_callback(_dma[0], NULL, NULL);
+          dma_channel_unclaim(_dma[0]);
+          _dma[0] = -1;
+        }
+        if (_dma[1] >= 0) {
+          RP2040_Tone_Scheduler::set_dma_callback(_dma[1], NULL, NULL);
+          dma_channel_unclaim(_dma[1]);
+          _dma[1] = -1;
+        }
+        if (_pio != NULL) {
+          park_pio();
+          pio_sm_unclaim(_pio, _pioSm);
+        }
+        if (_streamBuf != NULL) {
+          RP2040_Tone_Scheduler::release_stream_buffer(_streamBuf);
+        }
+        if (_voices != NULL) {
+          RP2040_Tone_Scheduler::release_voices(_voices);
+        }
+        if (_sink.ring != NULL) {
+          RP2040_Tone_Scheduler::release_sink_ring(_sink.ring);
+        }
+        if (_pcmTimer >= 0) {
+          dma_timer_unclaim(_pcmTimer);
+        }
+      }
+
+      /// @brief Claim the DMA channels the engine needs, panicking if we run
+      /// out (same as the slice assert). From the constructor and wake().
+      void claim_dma() {
+        if (_engine == TONE_ENGINE_TIMER) {
+          return;
+        }
+        _dma[0] = dma_claim_unused_channel(true);
+        if (_engine == TONE_ENGINE_PIO) {
+          return;
+        }
+        _dma[1] = dma_claim_unused_channel(true);
+        if (stream_engine()) {
+          RP2040_Tone_Scheduler::set_dma_callback(_dma[0], nco_dma_cb, this, stats_block());
+          RP2040_Tone_Scheduler::set_dma_callback(_dma[1], nco_dma_cb, this, stats_block());
+        }
+      }
+
+      /// @brief Where this instance's interrupts count, NULL without TONE_STATS
+      tone_stats *stats_block() {
+#if TONE_STATS
+        return &_stats;
+#else
+        return NULL;
+#endif
+      }
+
+      /// @brief Start the quiet time before power down, from thread code or
+      /// a DMA interrupt. Nothing to do if already asleep, or off the
+      /// engine's core (it has to go on that core's alarm): the engine's
+      /// next stop starts it instead.
+      void arm_idle() {
+        if (_timerData.idleUs != 0 && !_asleep && get_core_num() == _core) {
+          RP2040_Tone_Scheduler::schedule_in_us(&_idleEvent, _timerData.idleUs);
+        }
+      }
+
+      /// @brief arm_idle() for the scheduler's callbacks, which already hold
+      /// its lock
+      static void __not_in_flash_func(idle_from_callback)(struct timer_data *tData) {
+        if (tData->idleUs != 0) {
+          RP2040_Tone_Scheduler::schedule_from_callback(tData->idle,
+                                                        time_us_64() + tData->idleUs);
+        }
+      }
+
+      /// @brief The output has been quiet for set_idle_timeout(): give back
+      /// what can be claimed again and leave the pins low without the slice.
+      /// Runs with the scheduler's lock held; anything that starts a note
+      /// cancels this first, so the engine is stopped.
+      static bool __not_in_flash_func(idle_cb)(struct tone_event *event) {
+        RP2040_Volume *self = (RP2040_Volume*)event->user_data;
+        if (self->_timerData.active) {
+          return false;
+        }
+        if (self->_engine != TONE_ENGINE_PIO) {
+          pwm_set_enabled(self->_sliceNum, false);
+          self->park_pin(self->_pinPlus);
+          if (self->_diff) {
+            self->park_pin(self->_pinMinus);
+          }
+        }
+        for (int i = 0; i < 2; i++) {
+          if (self->_dma[i] >= 0) {
+            RP2040_Tone_Scheduler::set_dma_callback(self->_dma[i], NULL, NULL);
+            dma_channel_unclaim(self->_dma[i]);
+            self->_dma[i] = -1;
+          }
+        }
+        if (self->_pcmTimer >= 0) {
+          dma_timer_unclaim(self->_pcmTimer); // play_pcm() claims another
+          self->_pcmTimer = -1;
+        }
+        self->_asleep = true;
+        return false;
+      }
+
+      /// @brief Drive a pin low as a plain GPIO
+      static void park_pin(uint8_t pin) {
+        gpio_put(pin, 0);
+        gpio_set_dir(pin, GPIO_OUT);
+        gpio_set_function(pin, GPIO_FUNC_SIO);
+      }
+
+      /// @brief Undo idle_cb() before a note starts. Also stops a pending
+      /// power down, the quiet time restarts when this note ends.
+      void wake() {
+        RP2040_Tone_Scheduler::cancel(&_idleEvent);
+        if (!_asleep) {
+          return;
+        }
+        uint32_t start = time_us_32();
+        claim_dma();
+        if (_engine != TONE_ENGINE_PIO) {
+          gpio_set_function(_pinPlus, GPIO_FUNC_PWM);
+          if (_diff) {
+            gpio_set_function(_pinMinus, GPIO_FUNC_PWM);
+          }
+        }
+        _asleep = false;
+        _wakeUs = time_us_32() - start;
+      }
+
+      tone_note make_note(const tone_request &request) {
+        if (request.freq_mHz == 0) {
+          return make_rest(request.durationUs);
+        }
+        uint32_t usPerWave = request.usPerWave;
+        if (usPerWave == 0) {
+          usPerWave = freq_to_us(request.freq_mHz); // posted from an ISR
+        }
+        tone_note note = make_note_fixed(request.freq_mHz, usPerWave,
+                                         request.level, request.durationUs);
+        if (request.endFreq_mHz != 0 && request.endFreq_mHz != request.freq_mHz) {
+          add_sweep(note, request);
+        }
+        if (request.freq2_mHz != 0 && stream_engine()) {
+          note.nco.phaseInc2 = (uint32_t)(((uint64_t)request.freq2_mHz * _ncoIncScale) >> 16);
+          if (_engine == TONE_ENGINE_NCO) {
+            note.nco.gapSamples = us_to_samples(request.gapUs);
+            note.nco.samples += note.nco.gapSamples;
+          }
+        }
+        return note;
+      }
+
+      /// @brief Work out the per-tick deltas of a sweep for this engine. Runs
+      /// once per note, so it can afford the float math.
+      void add_sweep(tone_note &note, const tone_request &request) {
+        uint32_t f0 = request.freq_mHz;
+        uint32_t f1 = request.endFreq_mHz;
+        bool linear = request.curve == TONE_SWEEP_LINEAR;
+
+        if (stream_engine()) {
+          uint32_t inc1 = (uint32_t)(((uint64_t)f1 * _ncoIncScale) >> 16);
+          note.sweep = make_sweep(note.nco.phaseInc, inc1,
+                                  note.nco.samples / TONE_STREAM_BLOCK, request.curve);
+        } else if (_engine == TONE_ENGINE_TIMER) {
+          // Whole periods in the sweep: the integral of the frequency
+          double cycles;
+          if (linear) {
+            cycles = ((double)f0 + f1) / 2;
+          } else {
+            cycles = ((double)f1 - f0) / log((double)f1 / f0);
+          }
+          cycles *= request.durationUs / 1e9;
+          uint32_t periods = (uint32_t)(cycles + 0.5);
+          note.timer.numRepeats = periods > 0 ? 2 * periods : 1;
+          if (linear) {
+            // Constant mHz per microsecond, scaled by each period's length
+            note.sweep = make_sweep(f0, f1, clamp_us(request.durationUs), TONE_SWEEP_LINEAR);
+            note.sweep.ticksLeft = periods;
+            note.sweep.perUs = true;
+          } else {
+            // An exponential chirp rises by the same mHz every period
+            note.sweep = make_sweep(f0, f1, periods, TONE_SWEEP_LINEAR);
+          }
+        }
+      }
+
+      tone_sweep make_sweep(uint32_t from, uint32_t to, uint32_t ticks, uint8_t curve) {
+        tone_sweep sweep = tone_sweep();
+        sweep.on = true;
+        sweep.curve = curve == TONE_SWEEP_LINEAR ? TONE_SWEEP_LINEAR : TONE_SWEEP_EXPONENTIAL;
+        sweep.pos = (uint64_t)from << 16;
+        sweep.ticksLeft = ticks;
+        if (ticks == 0) {
+          return sweep;
+        }
+        if (sweep.curve == TONE_SWEEP_LINEAR) {
+          sweep.step = (((int64_t)to - (int64_t)from) << 16) / ticks;
+        } else {
+          double ratio = pow((double)to / from, 1.0 / ticks) * (1 << 30);
+          sweep.ratio = (uint32_t)(ratio < 2147483648.0 ? ratio + 0.5 : 2147483648.0);
+        }
+        return sweep;
+      }
+
+      /// @brief Convert a note in integer units to engine units
+      /// @param level Fraction of full volume, 65536 = 100%
+      tone_note make_note_fixed(uint32_t freq_mHz, uint32_t usPerWave,
+                                uint32_t level, uint64_t duration_us) {
+        if (level > 65536) {
+          level = 65536;
+        }
+
+        tone_note note;
+        note.level = (uint16_t)(((uint64_t)level * _top + 32768) >> 16);
+        note.durationUs = duration_us;
+        if (_engine == TONE_ENGINE_PIO) {
+          fill_pio_words(note.level, note.ccWords);
+        } else {
+          fill_cc_words(note.level, note.ccWords);
+        }
+        if (stream_engine()) {
+          note.nco.phaseInc = (uint32_t)(((uint64_t)freq_mHz * _ncoIncScale) >> 16);
+          note.nco.samples = us_to_samples(duration_us);
+          note.nco.phaseInc2 = 0;
+          note.nco.gapSamples = 0;
+          note.envelope = make_envelope(_blockUs);
+        } else if (_engine == TONE_ENGINE_TIMER) {
+          note.timer.usPerWave = usPerWave;
+          note.timer.numRepeats = clamp_us(duration_us / usPerWave);
+          note.envelope = make_envelope(2 * usPerWave);
+        } else {
+          note.dma.halfCarriers = freq_to_carriers(freq_mHz);
+          note.envelope.on = false;
+        }
+        note.sweep.on = false; // see add_sweep()
+        return note;
+      }
+
+      /// @brief Convert the set_envelope() times to steps per engine tick
+      tone_envelope make_envelope(uint32_t tick_us) {
+        tone_envelope envelope = tone_envelope();
+        envelope.on = _adsr.on;
+        if (!envelope.on) {
+          return envelope;
+        }
+        uint32_t attackTicks = (_adsr.attackUs + tick_us / 2) / tick_us;
+        uint32_t decayTicks = (_adsr.decayUs + tick_us / 2) / tick_us;
+        uint32_t releaseTicks = (_adsr.releaseUs + tick_us / 2) / tick_us;
+        // Round steps up so each stage finishes within its time
+        envelope.attackStep = attackTicks ? (65536 + attackTicks - 1) / attackTicks : 0;
+        envelope.decayStep = decayTicks ? (65536 - _adsr.sustain + decayTicks - 1) / decayTicks
+                                        : 65536;
+        envelope.sustain = _adsr.sustain;
+        // From the sustain level, so it lands on silence as the note ends
+        uint32_t releaseFrom = _adsr.sustain > 0 ? _adsr.sustain : 1;
+        envelope.releaseStep = releaseTicks ? (releaseFrom + releaseTicks - 1) / releaseTicks
+                                            : 65536;
+        envelope.releaseTicks = releaseTicks;
+        return envelope;
+      }
+
+      /// @brief A rest is a single "half period" as long as the rest at level 0
+      tone_note make_rest(uint64_t duration_us) {
+        tone_note note;
+        note.level = 0;
+        note.durationUs = duration_us;
+        note.ccWords[0] = 0;
+        note.ccWords[1] = 0;
+        if (_engine == TONE_ENGINE_PIO) {
+          fill_pio_words(0, note.ccWords);
+        }
+        if (stream_engine()) {
+          note.nco.phaseInc = 0;
+          note.nco.phaseInc2 = 0;
+          note.nco.gapSamples = 0;
+          note.nco.samples = us_to_samples(duration_us);
+        } else if (_engine == TONE_ENGINE_TIMER) {
+          note.timer.usPerWave = duration_us > 0 ? clamp_us(duration_us) : 1;
+          note.timer.numRepeats = 1;
+        } else {
+          note.dma.halfCarriers = 1;
+        }
+        note.envelope.on = false;
+        note.sweep.on = false;
+        return note;
+      }
+
+      /// @brief Engines that render blocks into _streamBuf
+      bool stream_engine() const {
+        return _engine == TONE_ENGINE_NCO || _engine == TONE_ENGINE_MIXER;
+      }
+
+      /// @brief tone() and friends: replace whatever is playing, or start
+      /// another voice on the mixer.
+      int8_t play(const tone_note &note) {
+        if (_engine == TONE_ENGINE_MIXER) {
+          return start_voice(note);
+        }
+        halt_engine();
+        _queue.clear();
+        start_note(note);
+        return 0;
+      }
+
+      bool enqueue(const tone_note &note) {
+        if (_engine == TONE_ENGINE_MIXER) {
+          return false;
+        }
+        if (!_queue.push(note)) {
+          return false;
+        }
+        // The engine clears active from its interrupt when it runs dry, so
+        // keep it out while we decide whether it needs a kick.
+        uint32_t save = save_and_disable_interrupts();
+        if (!_timerData.active) {
+          tone_note first;
+          _queue.pop(first);
+          start_note(first);
+        }
+        restore_interrupts(save);
+        return true;
+      }
+
+      /// @brief (Re)initialise the slice and start the engine on a note. Only
+      /// used when nothing is playing; queued notes are chained by the engine.
+      void start_note(const tone_note &note) {
+        configure_note(note);
+
+        if (_engine == TONE_ENGINE_PIO) {
+          pio_sm_set_enabled(_pio, _pioSm, true); // no slice of our own
+        } else {
+          pwm_set_counter(_sliceNum, 0);
+
+          pwm_set_enabled(_sliceNum, true); // Turn on PWM now that we're all set
+        }
+
+        schedule_note(note, time_us_64());
+      }
+
+      /// @brief First half of start_note(): set up the slice and engine for a
+      /// note but leave the slice disabled, so nothing moves until it's
+      /// enabled (the DMA engines wait for its first wrap DREQ).
+      void configure_note(const tone_note &note) {
+        wake();
+        _level = note.level;
+
+        if (_engine == TONE_ENGINE_PIO) {
+          init_sm();
+        } else {
+          init_slice();
+
+          *_timerData.cc = note.ccWords[0];
+        }
+
+        _timerData.active = true;
+
+        if (_engine == TONE_ENGINE_DMA) {
+          start_dma(note);
+        } else if (_engine == TONE_ENGINE_PIO) {
+          start_pio(note);
+        } else if (_engine == TONE_ENGINE_NCO) {
+          load_nco(note);
+          start_stream();
+        } else if (_engine == TONE_ENGINE_MIXER) {
+          start_stream(); // voices are already set up by start_voice()
+        } else {
+          load_timer_note(&_timerData, note);
+
+          _edge.callback = _timerData.deadline ? deadline_timer_cb : _timerCb;
+          _edge.user_data = (void *)&_timerData;
+          _edge.delay_us = note.timer.usPerWave;
+
+          if (_timerData.deadline) {
+            RP2040_Tone_Scheduler::cancel(&_stopEvent);
+            _stopEvent.callback = timer_stop_cb;
+            _stopEvent.user_data = this;
+            _stopEvent.delay_us = note.durationUs;
+          }
+        }
+      }
+
+      /// @brief Set up the slice for the carrier, leaving it disabled
+      void init_slice() {
+        pwm_config config = pwm_get_default_config();
+        
+        // Disable these outputs while we configure:
+        pwm_set_enabled(_sliceNum, false);
+
+        // Turn on phase correction:
+        pwm_config_set_phase_correct(&config, _phaseCorrect);
+
+        // Run PWM at the speed set_carrier() picked
+        pwm_config_set_clkdiv_int_frac(&config, _clkdiv16 >> 4, _clkdiv16 & 0xf);
+
+        // Specify what the PWM counter rolls over at:
+        pwm_config_set_wrap(&config, _top);
+
+        // Initialize, but don't start yet:
+        pwm_init(_sliceNum, &config, false);
+      }
+
+      /// @brief Second half of start_note(): schedule the note's timing
+      /// relative to start, the time (us since boot) the slice was enabled.
+      void schedule_note(const tone_note &note, uint64_t start) {
+        if (_engine == TONE_ENGINE_DMA || _engine == TONE_ENGINE_PIO) {
+          RP2040_Tone_Scheduler::schedule_at(&_stopEvent, start + note.durationUs);
+        } else if (_engine == TONE_ENGINE_TIMER) {
+          if (_timerData.deadline) {
+            _timerData.endAt = start + note.durationUs;
+            RP2040_Tone_Scheduler::schedule_at(&_stopEvent, _timerData.endAt);
+          }
+          RP2040_Tone_Scheduler::schedule_at(&_edge, start + note.timer.usPerWave);
+        }
+      }
+
+      /// @brief Stop whichever engine is running and make sure its interrupt
+      /// is done with the shared state. Leaves the pins where they are.
+      void halt_engine() {
+        if (_engine == TONE_ENGINE_DMA || _engine == TONE_ENGINE_PIO) {
+          RP2040_Tone_Scheduler::cancel(&_stopEvent);
+          abort_dma();
+        } else if (stream_engine()) {
+          abort_dma();
+          _pcm.data = NULL;
+          if (_sink.ring != NULL) {
+            RP2040_Tone_Scheduler::release_sink_ring(_sink.ring);
+            _sink.ring = NULL;
+          }
+        } else {
+          cancel_timer();
+        }
+        _timerData.active = false;
+        __sev(); // wake wait_done()
+      }
+
+      /// @brief End of a note, from the interrupt that ended it. last clears
+      /// active once the engine has stopped. Either way wait_done() gets an
+      /// event to re-check on and the user's callback runs.
+      static void __not_in_flash_func(note_done)(struct timer_data *tData, bool last) {
+        if (last) {
+          tData->active = false;
+        }
+        __sev();
+        if (tData->done != NULL) {
+          tData->done(tData->doneData, last);
+        }
+      }
+
+      /// @brief Runs on every edge, so it lives in RAM (no XIP cache misses)
+      /// and only ever does a single store to the CC register.
+      static bool __not_in_flash_func(timer_cb)(struct tone_event *data) {
+        struct timer_data *tData = (timer_data*)(data->user_data);
+        tData->repeats++;
+        if (tData->repeats >= tData->numRepeats) {
+          return next_note(data, tData);
+        }
+
+        tData->high ^= 1;
+        if (tData->high == 0 && (tData->envelope.on || tData->sweep.on)) {
+          next_period(data, tData);
+        }
+        *tData->cc = tData->ccWords[tData->high];
+
+        return true;
+
+      }
+
+      /// @brief Edge callback with set_deadline_timing(): no counting, the
+      /// note's end is its own event (timer_stop_cb)
+      static bool __not_in_flash_func(deadline_timer_cb)(struct tone_event *data) {
+        struct timer_data *tData = (timer_data*)(data->user_data);
+        tData->high ^= 1;
+        if (tData->high == 0 && (tData->envelope.on || tData->sweep.on)) {
+          next_period(data, tData);
+        }
+        *tData->cc = tData->ccWords[tData->high];
+        return true;
+      }
+
+      /// @brief End of a note with set_deadline_timing(): start the next
+      /// queued note on the deadline (re-phasing the edges to it) or park the
+      /// outputs low. The last half period is cut short either way.
+      static bool __not_in_flash_func(timer_stop_cb)(struct tone_event *event) {
+        RP2040_Volume *self = (RP2040_Volume*)event->user_data;
+        struct timer_data *tData = &self->_timerData;
+        tone_note next;
+        if (tData->queue->pop(next)) {
+          load_timer_note(tData, next);
+          *tData->cc = next.ccWords[0];
+          self->_level = next.level;
+          self->_edge.delay_us = next.timer.usPerWave;
+          RP2040_Tone_Scheduler::schedule_from_callback(&self->_edge,
+                                                        event->deadline + next.timer.usPerWave);
+          tData->endAt = event->deadline + next.durationUs;
+          event->delay_us = next.durationUs;
+          note_done(tData, false);
+          return true;
+        }
+        RP2040_Tone_Scheduler::cancel_from_callback(&self->_edge);
+        // 0% duty cycle, but leave running so they go to low correctly
+        *tData->cc = 0;
+        note_done(tData, true);
+        idle_from_callback(tData);
+        return false;
+      }
+
+      /// @brief Last edge of a note: chain into the next queued note or park
+      /// the outputs low and stop the timer.
+      static bool __not_in_flash_func(next_note)(struct tone_event *data,
+                                                 struct timer_data *tData) {
+        tone_note next;
+        if (tData->queue->pop(next)) {
+          // Chain straight into the next note on this edge, the slice keeps
+          // running so there is no gap.
+          load_timer_note(tData, next);
+          data->delay_us = next.timer.usPerWave;
+          *tData->cc = next.ccWords[0];
+          note_done(tData, false);
+          return true;
+        }
+        // Set PWMS to 0% duty cycle, but leave running so they go to low correctly
+        *tData->cc = 0;
+        note_done(tData, true);
+        idle_from_callback(tData);
+        return false; // this stops when needed. Might be some slack in this...
+      }
+
+      /// @brief Point the timer engine at a note, starting on the low half
+      static void __not_in_flash_func(load_timer_note)(struct timer_data *tData,
+                                                       const tone_note &note) {
+        tData->numRepeats = note.timer.numRepeats;
+        tData->repeats = 0;
+        tData->high = 0; // starts as low so we turn it off first.
+        tData->ccWords[0] = note.ccWords[0];
+        tData->ccWords[1] = note.ccWords[1];
+        tData->sweep = note.sweep;
+        tData->envelope = note.envelope;
+        if (note.envelope.on) {
+          tData->peak = note.level;
+          note.envelope.start(tData->envState);
+          set_timer_level(tData, tData->envState.value);
+        }
+      }
+
+      /// @brief Once per period of the tone, move the level along the
+      /// envelope and the frequency along the sweep
+      static void __not_in_flash_func(next_period)(struct tone_event *data,
+                                                   struct timer_data *tData) {
+        if (tData->envelope.on) {
+          uint32_t periodsLeft;
+          if (tData->deadline) {
+            uint64_t left = tData->endAt > data->deadline ? tData->endAt - data->deadline : 0;
+            periodsLeft = clamp_us(left) / (2 * (uint32_t)data->delay_us);
+          } else {
+            periodsLeft = (tData->numRepeats - tData->repeats) >> 1;
+          }
+          set_timer_level(tData, tData->envelope.step(tData->envState, periodsLeft));
+        }
+        if (tData->sweep.on) {
+          uint32_t freq_mHz = tData->sweep.next(tData->sweep.perUs ? 2 * (uint32_t)data->delay_us : 1);
+          freq_mHz = freq_mHz > 0 ? freq_mHz : 1;
+          uint32_t us = (500000000u + freq_mHz/2) / freq_mHz; // as freq_to_us()
+          data->delay_us = us > 0 ? us : 1;
+        }
+      }
+
+      static void __not_in_flash_func(set_timer_level)(struct timer_data *tData,
+                                                       uint32_t envelope) {
+        uint32_t level = (tData->peak * envelope) >> 16;
+        tData->ccWords[0] = tData->diff ? level << tData->shiftMinus : 0;
+        tData->ccWords[1] = level << tData->shiftPlus;
+      }
+
+      void cancel_timer() {
+        RP2040_Tone_Scheduler::cancel(&_stopEvent);
+        RP2040_Tone_Scheduler::cancel(&_edge);
+      }
+
+      /// @brief Number of PWM carrier periods (wrap DREQs) per half period of
+      /// the tone for the DMA engine.
+      /// @param freq_mHz (milli-Hertz)
+      /// @return uint32_t carrier periods per half period (rounded, at least 1)
+      uint32_t freq_to_carriers(uint32_t freq_mHz) {
+        uint32_t halfCarriers = (_carrierMilliHz + freq_mHz) / (2 * freq_mHz);
+        return halfCarriers > 0 ? halfCarriers : 1;
+      }
+
+      /// @brief Start the DMA engine. _dma[0] writes the same CC word into the
+      /// slice on every wrap DREQ for one half period, then chains to _dma[1],
+      /// which writes the address of the other half's word into _dma[0]'s
+      /// READ_ADDR trigger alias. That restarts _dma[0] (re-loading its
+      /// transfer count) so the pair runs indefinitely with no CPU assistance.
+      /// A single event stops it at the end of the note.
+      void start_dma(const tone_note &note) {
+        abort_dma();
+        _ccPair = 0;
+        _ccWords[0][0] = note.ccWords[0];
+        _ccWords[0][1] = note.ccWords[1];
+        _ccWordAddrs[0] = &_ccWords[0][0];
+        _ccWordAddrs[1] = &_ccWords[0][1];
+
+        dma_channel_config c = dma_channel_get_default_config(_dma[0]);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+        channel_config_set_read_increment(&c, false);
+        channel_config_set_write_increment(&c, false);
+        channel_config_set_dreq(&c, pwm_get_dreq(_sliceNum));
+        channel_config_set_chain_to(&c, _dma[1]);
+        dma_channel_configure(_dma[0], &c, &pwm_hw->slice[_sliceNum].cc,
+                              _ccWordAddrs[0], note.dma.halfCarriers, false);
+
+        c = dma_channel_get_default_config(_dma[1]);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+        channel_config_set_read_increment(&c, true);
+        channel_config_set_write_increment(&c, false);
+        channel_config_set_ring(&c, false, 3); // wrap over both addresses
+        // starts on [1] as _dma[0] is kicked off by hand on [0]
+        dma_channel_configure(_dma[1], &c,
+                              &dma_hw->ch[_dma[0]].al3_read_addr_trig,
+                              &_ccWordAddrs[1], 1, false);
+
+        RP2040_Tone_Scheduler::cancel(&_stopEvent);
+        _stopEvent.callback = dma_stop_cb;
+        _stopEvent.user_data = this;
+        _stopEvent.delay_us = note.durationUs; // scheduled by schedule_note()
+
+        dma_channel_start(_dma[0]); // waits for the first wrap DREQ
+      }
+
+      /// @brief Check the PIO pin pair and hand both pins to PIO. Differential
+      /// pins can be on any slices but must be next to each other, as they're
+      /// driven as one pin group.
+      void init_pio_pins(uint8_t pin_plus, uint8_t pin_minus) {
+        _pinPlus = pin_plus;
+        _pinMinus = _diff ? pin_minus : 255;
+        RP2040_Tone_Pio::claim(&_pio, &_pioSm, &_pioOffset);
+        if (_diff) {
+          assert (pin_minus == pin_plus + 1 || pin_plus == pin_minus + 1);
+          _pioBase = pin_plus < pin_minus ? pin_plus : pin_minus;
+          _pioCount = 2;
+          _pioPlus = pin_plus < pin_minus ? 1 : 2;
+          _pioMinus = (uint8_t)(3 - _pioPlus);
+          pio_gpio_init(_pio, _pinMinus);
+        } else {
+          _pioBase = pin_plus;
+          _pioCount = 1;
+          _pioPlus = 1;
+          _pioMinus = 0;
+        }
+        pio_gpio_init(_pio, _pinPlus);
+
+        init_sm();
+        park_pio();
+      }
+
+      /// @brief (Re)configure the state machine for the carrier, leaving it
+      /// disabled with empty FIFOs at the start of the program
+      void init_sm() {
+        pio_sm_config c = pio_get_default_sm_config();
+        sm_config_set_wrap(&c, _pioOffset, _pioOffset + RP2040_Tone_Pio::WRAP);
+        sm_config_set_out_pins(&c, _pioBase, _pioCount);
+        sm_config_set_set_pins(&c, _pioBase, _pioCount);
+        sm_config_set_out_shift(&c, true, false, 32);
+        // Same divider as the slice would use, the carrier loop takes the
+        // cycles of one PWM wrap
+        sm_config_set_clkdiv_int_frac(&c, _clkdiv16 >> 4, (uint8_t)((_clkdiv16 & 0xf) << 4));
+        pio_sm_set_enabled(_pio, _pioSm, false);
+        pio_sm_set_consecutive_pindirs(_pio, _pioSm, _pioBase, _pioCount, true);
+        pio_sm_init(_pio, _pioSm, _pioOffset, &c);
+      }
+
+      /// @brief Stop the state machine and drive its pins low. Safe from the
+      /// end of note interrupt.
+      void __not_in_flash_func(park_pio)() {
+        pio_sm_set_enabled(_pio, _pioSm, false);
+        pio_sm_exec(_pio, _pioSm, pio_encode_set(pio_pins, 0));
+      }
+
+      /// @brief Work out the PIO carrier word for each half of the wave, the
+      /// PIO engine's equivalent of fill_cc_words()
+      void fill_pio_words(uint16_t level, uint32_t words[2]) {
+        // Cycles in one PWM wrap, see set_carrier()
+        uint32_t period = (uint32_t)(_top + 1) * (_phaseCorrect ? 2 : 1);
+        assert (period >= 16 && period <= 32775);
+        uint32_t high = ((uint32_t)level * period + _top / 2) / _top;
+        words[0] = pio_word(high, period, _pioMinus);
+        words[1] = pio_word(high, period, _pioPlus);
+      }
+
+      /// @brief One carrier word: high for high cycles on pins, then low for
+      /// the rest of the period
+      static uint32_t pio_word(uint32_t high, uint32_t period, uint32_t pins) {
+        if (high == 0 || pins == 0) {
+          return (period - 8) << 17; // silent, same period
+        }
+        // The loop puts at least 4 cycles in each part
+        if (high < 4) {
+          high = 4;
+        } else if (high > period - 4) {
+          high = period - 4;
+        }
+        uint32_t h = high - 4;
+        return (period - 8 - h) << 17 | h << 2 | pins;
+      }
+
+      /// @brief Start the PIO engine: _dma[0] keeps the TX FIFO topped up from
+      /// the 4 words in _pioWords, paced by the FIFO's DREQ, until the end of
+      /// the note. The state machine is enabled by start_note().
+      void start_pio(const tone_note &note) {
+        abort_dma();
+        load_pio_words(note);
+
+        dma_channel_config c = dma_channel_get_default_config(_dma[0]);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+        channel_config_set_read_increment(&c, true);
+        channel_config_set_write_increment(&c, false);
+        channel_config_set_ring(&c, false, 4); // wrap over all 4 words
+        channel_config_set_dreq(&c, pio_get_dreq(_pio, _pioSm, true));
+        // Good for hours of half periods, the note end stops it long before
+        dma_channel_configure(_dma[0], &c, &_pio->txf[_pioSm], _pioWords,
+                              0xffffffffu, true);
+
+        RP2040_Tone_Scheduler::cancel(&_stopEvent);
+        _stopEvent.callback = pio_stop_cb;
+        _stopEvent.user_data = this;
+        _stopEvent.delay_us = note.durationUs; // scheduled by schedule_note()
+      }
+
+      void __not_in_flash_func(load_pio_words)(const tone_note &note) {
+        uint32_t carriers = note.dma.halfCarriers > 0 ? note.dma.halfCarriers - 1 : 0;
+        _pioWords[0] = carriers;
+        _pioWords[1] = note.ccWords[0];
+        _pioWords[2] = carriers;
+        _pioWords[3] = note.ccWords[1];
+      }
+
+      /// @brief Work out the CC register word for each half of the wave. The
+      /// slice is ours (tone() re-inits it), so both channels get written.
+      /// Also used by the envelope from the DMA interrupt.
+      void __not_in_flash_func(fill_cc_words)(uint16_t level, uint32_t words[2]) {
+        if (_diff) {
+          words[0] = (uint32_t)level << _nco.shiftMinus;
+          words[1] = (uint32_t)level << _nco.shiftPlus;
+        } else {
+          words[0] = 0;
+          words[1] = (uint32_t)level << _nco.shiftPlus;
+        }
+      }
+
+      /// @brief Halts both DMA channels. They chain to each other, so they
+      /// have to be aborted together or one will restart the other.
+      void abort_dma() {
+        if (_dma[0] < 0) {
+          return;
+        }
+        uint32_t mask = (1u << _dma[0]) | (_dma[1] >= 0 ? 1u << _dma[1] : 0);
+        // Aborting can raise a spurious completion IRQ (RP2040-E13), so mask
+        // ours off first and clear anything left pending afterwards.
+        hw_clear_bits(RP2040_Tone_Scheduler::dma_inte(_core), mask);
+        dma_hw->abort = mask;
+        while (dma_hw->abort & mask) {
+          tight_loop_contents();
+        }
+        *RP2040_Tone_Scheduler::dma_ints(_core) = mask;
+      }
+
+      /// @brief Carrier periods in a duration, for the NCO engine
+      uint32_t us_to_samples(uint64_t us) {
+        // Whole samples per us (carriers of 1 MHz and up) and the fraction
+        // separately, so neither product overflows
+        uint64_t whole = us * (_ncoSamplesPerUs >> 32);
+        uint32_t frac = (uint32_t)_ncoSamplesPerUs;
+        if (us >= (uint64_t)1 << 32) {
+          return clamp_us(whole + ((us >> 16) * frac >> 16));
+        }
+        return clamp_us(whole + ((us * frac) >> 32));
+      }
+
+      /// @brief Fit a 64-bit count into the 32-bit fields of the engines that
+      /// count (71 minutes of microseconds)
+      static uint32_t clamp_us(uint64_t value) {
+        return value > 0xffffffffu ? 0xffffffffu : (uint32_t)value;
+      }
+
+      /// @brief Start the NCO/mixer engine: render both blocks, then let the
+      /// two channels ping-pong between them. Each one raises the engine
+      /// core's DMA IRQ when its block is done, and nco_dma_cb refills it while the other plays.
+      void start_stream() {
+        RP2040_Tone_Scheduler::install_dma_irq();
+        abort_dma();
+        _nco.phase = 0; // starts on the low half, same as the timer engine
+        _nco.drain = 0;
+        render_stream(_streamBuf);
+        render_stream(_streamBuf + TONE_STREAM_BLOCK);
+
+        for (int i = 0; i < 2; i++) {
+          dma_channel_config c = dma_channel_get_default_config(_dma[i]);
+          channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+          channel_config_set_read_increment(&c, true);
+          channel_config_set_write_increment(&c, false);
+          // PCM goes out at its own sample rate, everything else once per
+          // carrier period
+          channel_config_set_dreq(&c, _pcm.data != NULL ? dma_get_timer_dreq(_pcmTimer)
+                                                        : pwm_get_dreq(_sliceNum));
+          channel_config_set_chain_to(&c, _dma[i ^ 1]);
+          dma_channel_configure(_dma[i], &c, &pwm_hw->slice[_sliceNum].cc,
+                                _streamBuf + i * TONE_STREAM_BLOCK,
+                                TONE_STREAM_BLOCK, false);
+        }
+        uint32_t mask = (1u << _dma[0]) | (1u << _dma[1]);
+        *RP2040_Tone_Scheduler::dma_ints(_core) = mask;
+        hw_set_bits(RP2040_Tone_Scheduler::dma_inte(_core), mask);
+
+        dma_channel_start(_dma[0]); // waits for the first wrap DREQ
+      }
+
+      void load_nco(const tone_note &note) {
+        _level = note.level;
+        _nco.phaseInc = note.nco.phaseInc;
+        _nco.phaseInc2 = note.nco.phaseInc2;
+        _nco.samplesLeft = note.nco.samples;
+        _nco.gapSamples = note.nco.gapSamples;
+        _nco.ccWords[0] = note.ccWords[0];
+        _nco.ccWords[1] = note.ccWords[1];
+        _nco.level = note.level;
+        _nco.sweep = note.sweep;
+        _nco.envelope = note.envelope;
+        if (note.envelope.on) {
+          _nco.peak = note.level;
+          note.envelope.start(_nco.envState);
+          set_nco_level(_nco.envState.value);
+        }
+      }
+
+      /// @brief Once per block, move the NCO's level along the envelope
+      void __not_in_flash_func(step_nco_envelope)() {
+        uint32_t sounding = _nco.samplesLeft > _nco.gapSamples
+                            ? _nco.samplesLeft - _nco.gapSamples : 0;
+        uint32_t blocksLeft = sounding / TONE_STREAM_BLOCK;
+        set_nco_level(_nco.envelope.step(_nco.envState, blocksLeft));
+      }
+
+      void __not_in_flash_func(set_nco_level)(uint32_t envelope) {
+        _nco.level = (int32_t)(((uint32_t)_nco.peak * envelope) >> 16);
+        fill_cc_words((uint16_t)_nco.level, _nco.ccWords);
+      }
+
+      /// @brief Fill one block with CC words from the phase accumulator. The
+      /// top bit of the phase picks the half. Queued notes are picked up on
+      /// the exact carrier period the previous one ends, phase continuous.
+      /// @return false if the queue ran dry (the rest of the block is silent)
+      bool __not_in_flash_func(render_nco)(uint32_t *buf) {
+        uint32_t *end = buf + TONE_STREAM_BLOCK;
+        if (_nco.envelope.on && _nco.samplesLeft != 0) {
+          step_nco_envelope();
+        }
+        if (_nco.sweep.on) {
+          _nco.phaseInc = _nco.sweep.next();
+        }
+        while (buf < end) {
+          if (_nco.samplesLeft == 0) {
+            tone_note next;
+            if (!_queue.pop(next)) {
+              while (buf < end) {
+                *buf++ = 0;
+              }
+              return false;
+            }
+            load_nco(next);
+            // Rendered a block ahead, so this is up to a block early
+            note_done(&_timerData, false);
+            continue; // zero-length notes are skipped
+          }
+          uint32_t run = (uint32_t)(end - buf);
+          if (_nco.samplesLeft <= _nco.gapSamples) {
+            // The silent tail of a dial() digit
+            if (run > _nco.samplesLeft) {
+              run = _nco.samplesLeft;
+            }
+            _nco.samplesLeft -= run;
+            while (run--) {
+              *buf++ = 0;
+            }
+            continue;
+          }
+          if (run > _nco.samplesLeft - _nco.gapSamples) {
+            run = _nco.samplesLeft - _nco.gapSamples;
+          }
+          _nco.samplesLeft -= run;
+
+          if (_nco.phaseInc2 != 0) {
+            render_dual(buf, run);
+            buf += run;
+            continue;
+          }
+          if (_nco.wave != TONE_WAVE_SQUARE) {
+            render_wave(buf, run);
+            buf += run;
+            continue;
+          }
+
+          uint32_t phase = _nco.phase;
+          uint32_t inc = _nco.phaseInc;
+          uint32_t low = _nco.ccWords[0];
+          uint32_t high = _nco.ccWords[1];
+          while (run--) {
+            phase += inc;
+            *buf++ = (phase & 0x80000000u) ? high : low;
+          }
+          _nco.phase = phase;
+        }
+        return true;
+      }
+
+      /// @brief Wavetable version of the render_nco inner loop: one table
+      /// lookup (or computed triangle) and a multiply per carrier period.
+      void __not_in_flash_func(render_wave)(uint32_t *buf, uint32_t run) {
+        uint32_t phase = _nco.phase;
+        uint32_t inc = _nco.phaseInc;
+        int32_t level = _nco.level;
+        const int16_t *table = _nco.table;
+        uint32_t tableShift = _nco.tableShift;
+        uint32_t shiftPlus = _nco.shiftPlus;
+        uint32_t shiftMinus = _nco.shiftMinus;
+        bool diff = _diff;
+
+        while (run--) {
+          phase += inc;
+          int32_t sample;
+          if (table != NULL) {
+            sample = table[phase >> tableShift];
+          } else {
+            // Fold the top 16 bits of phase into a triangle, -32767..32767
+            int32_t t = (int32_t)(phase >> 16);
+            sample = 2 * (t < 32768 ? t : 65535 - t) - 32767;
+          }
+          int32_t v = (sample * level) >> 15;
+          if (diff) {
+            *buf++ = v >= 0 ? (uint32_t)v << shiftPlus
+                            : (uint32_t)(-v) << shiftMinus;
+          } else {
+            *buf++ = (uint32_t)((level + v) >> 1) << shiftPlus;
+          }
+        }
+        _nco.phase = phase;
+      }
+
+      /// @brief Dual tone version of render_wave: two accumulators, two
+      /// lookups, and the average of the pair scaled by the level.
+      void __not_in_flash_func(render_dual)(uint32_t *buf, uint32_t run) {
+        uint32_t phase = _nco.phase;
+        uint32_t inc = _nco.phaseInc;
+        uint32_t phase2 = _nco.phase2;
+        uint32_t inc2 = _nco.phaseInc2;
+        int32_t level = _nco.level;
+        const int16_t *table = dual_table();
+        uint32_t tableShift = dual_table_shift();
+        uint32_t shiftPlus = _nco.shiftPlus;
+        uint32_t shiftMinus = _nco.shiftMinus;
+        bool diff = _diff;
+
+        while (run--) {
+          phase += inc;
+          phase2 += inc2;
+          int32_t sample = (table[phase >> tableShift] + table[phase2 >> tableShift]) >> 1;
+          int32_t v = (sample * level) >> 15;
+          if (diff) {
+            *buf++ = v >= 0 ? (uint32_t)v << shiftPlus
+                            : (uint32_t)(-v) << shiftMinus;
+          } else {
+            *buf++ = (uint32_t)((level + v) >> 1) << shiftPlus;
+          }
+        }
+        _nco.phase = phase;
+        _nco.phase2 = phase2;
+      }
+
+      /// @brief Dual tones use the custom table if one is set, else a sine
+      const int16_t *dual_table() const {
+        return _nco.wave == TONE_WAVE_CUSTOM ? _nco.table : TONE_SINE_TABLE.value;
+      }
+
+      uint32_t dual_table_shift() const {
+        return _nco.wave == TONE_WAVE_CUSTOM ? _nco.tableShift : 32 - 8;
+      }
+
+      bool start_pcm(const void *data, bool wide, size_t n, uint32_t sample_rate,
+                     uint16_t level_permille) {
+        if (!stream_engine() || sample_rate == 0) {
+          return false;
+        }
+        if (level_permille > 1000) {
+          level_permille = 1000;
+        }
+        if (_pcmTimer < 0) {
+          // Panics if we run out, same as the DMA channels
+          _pcmTimer = dma_claim_unused_timer(true);
+        }
+        // Not through submit(), so keep tone_from_isr() out by hand while
+        // the engine is rebuilt
+        RP2040_Tone_Scheduler::hold_isr_commands(true);
+        set_pcm_rate(sample_rate);
+
+        halt_engine();
+        _queue.clear();
+        for (int v = 0; _voices != NULL && v < TONE_MAX_VOICES; v++) {
+          _voices[v].active = false;
+        }
+        _pcm.wide = wide;
+        _pcm.left = n;
+        _pcm.scale = (int32_t)((uint32_t)level_permille * _top / 1000);
+        _pcm.data = data;
+        start_note(make_rest(0)); // renders from _pcm while _pcm.data is set
+        RP2040_Tone_Scheduler::hold_isr_commands(false);
+        return true;
+      }
+
+      /// @brief Pace _pcmTimer at sample_rate. The timer ticks at clk_sys *
+      /// num / den (both 16-bit), so try every numerator that keeps den in
+      /// range and keep the closest.
+      void set_pcm_rate(uint32_t sample_rate) {
+        uint64_t sysHz = clock_get_hz(clk_sys);
+        uint32_t bestNum = 1;
+        uint32_t bestDen = 0xffff;
+        uint64_t bestErr = UINT64_MAX;
+        for (uint32_t num = 1; num <= 0xffff; num++) {
+          uint64_t den = (num * sysHz + sample_rate / 2) / sample_rate;
+          if (den > 0xffff) {
+            break;
+          }
+          if (den == 0) {
+            continue;
+          }
+          // |num/den - rate/sys| scaled by den * sys
+          int64_t diff = (int64_t)(num * sysHz) - (int64_t)(den * sample_rate);
+          uint64_t err = (uint64_t)(diff < 0 ? -diff : diff) * 0x10000 / den;
+          if (err < bestErr) {
+            bestErr = err;
+            bestNum = num;
+            bestDen = (uint32_t)den;
+          }
+        }
+        dma_timer_set_fraction(_pcmTimer, (uint16_t)bestNum, (uint16_t)bestDen);
+      }
+
+      /// @brief Scale one block of PCM to CC words, then pad with silence
+      /// @return false once the samples have run out
+      bool __not_in_flash_func(render_pcm)(uint32_t *buf) {
+        uint32_t run = _pcm.left < TONE_STREAM_BLOCK ? _pcm.left : TONE_STREAM_BLOCK;
+        uint32_t *end = buf + TONE_STREAM_BLOCK;
+        int32_t scale = _pcm.scale;
+
+        const int16_t *wide = (const int16_t*)_pcm.data;
+        const uint8_t *narrow = (const uint8_t*)_pcm.data;
+        for (uint32_t i = 0; i < run; i++) {
+          int32_t sample = _pcm.wide ? wide[i] : ((int32_t)narrow[i] - 128) << 8;
+          *buf++ = pcm_word(sample, scale);
+        }
+        _pcm.data = _pcm.wide ? (const void*)(wide + run) : (const void*)(narrow + run);
+        _pcm.left -= run;
+        while (buf < end) {
+          *buf++ = 0;
+        }
+        return _pcm.left != 0;
+      }
+
+      /// @brief CC word for one PCM sample at full-scale level scale
+      inline uint32_t __not_in_flash_func(pcm_word)(int32_t sample, int32_t scale) const {
+        if (_diff) {
+          int32_t v = (sample * scale) >> 15;
+          return v >= 0 ? (uint32_t)v << _nco.shiftPlus
+                        : (uint32_t)(-v < scale ? -v : scale) << _nco.shiftMinus;
+        }
+        return (((uint32_t)(sample + 32768) * (uint32_t)scale) >> 16) << _nco.shiftPlus;
+      }
+
+      /// @brief Start the DMA pair for begin_stream(). Both channels start on
+      /// a block of silence (the first half of _streamBuf), then sink_dma_cb
+      /// points each one at the next full block of the ring as it finishes.
+      void start_sink() {
+        wake();
+        RP2040_Tone_Scheduler::install_dma_irq();
+        init_slice();
+        uint32_t idle = pcm_word(0, _sink.scale);
+        for (int i = 0; i < TONE_STREAM_BLOCK; i++) {
+          _streamBuf[i] = idle;
+        }
+        *_timerData.cc = idle;
+        _timerData.active = true;
+
+        for (int i = 0; i < 2; i++) {
+          dma_channel_config c = dma_channel_get_default_config(_dma[i]);
+          channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+          channel_config_set_read_increment(&c, true);
+          channel_config_set_write_increment(&c, false);
+          channel_config_set_dreq(&c, dma_get_timer_dreq(_pcmTimer));
+          channel_config_set_chain_to(&c, _dma[i ^ 1]);
+          dma_channel_configure(_dma[i], &c, &pwm_hw->slice[_sliceNum].cc,
+                                _streamBuf, TONE_STREAM_BLOCK, false);
+          _sink.fromRing[i] = false;
+        }
+        uint32_t mask = (1u << _dma[0]) | (1u << _dma[1]);
+        *RP2040_Tone_Scheduler::dma_ints(_core) = mask;
+        hw_set_bits(RP2040_Tone_Scheduler::dma_inte(_core), mask);
+
+        pwm_set_counter(_sliceNum, 0);
+        pwm_set_enabled(_sliceNum, true);
+        dma_channel_start(_dma[0]);
+      }
+
+      /// @brief A channel finished its block: hand its ring block back to
+      /// write() and queue it up on the next full one, or on silence.
+      void __not_in_flash_func(sink_dma_cb)(uint channel) {
+        const uint32_t size = TONE_SINK_BLOCKS * TONE_STREAM_BLOCK;
+        int i = channel == (uint)_dma[1];
+        if (_sink.fromRing[i]) {
+          uint32_t head = _sink.head + TONE_STREAM_BLOCK;
+          _sink.head = head == size ? 0 : head;
+        }
+
+        uint32_t next = _sink.next;
+        uint32_t filled = (_sink.tail + size - next) % size;
+        if (filled >= TONE_STREAM_BLOCK) {
+          __dmb(); // don't hand the words to the DMA before seeing them
+          dma_channel_set_read_addr(channel, _sink.ring + next, false);
+          next += TONE_STREAM_BLOCK;
+          _sink.next = next == size ? 0 : next;
+          _sink.fromRing[i] = true;
+        } else {
+          dma_channel_set_read_addr(channel, _streamBuf, false);
+          _sink.fromRing[i] = false;
+          _sink.underruns = _sink.underruns + 1;
+#if TONE_STATS
+          RP2040_Tone_Scheduler::add_underrun(&_stats);
+#endif
+        }
+      }
+
+      /// @brief Start a mixer voice on a free slot, and the engine if it was
+      /// idle.
+      /// @return Voice handle, -1 if all voices are busy
+      int8_t start_voice(const tone_note &note) {
+        for (int v = 0; v < TONE_MAX_VOICES; v++) {
+          tone_voice *voice = &_voices[v];
+          if (voice->active) {
+            continue;
+          }
+          voice->phase = 0;
+          voice->phaseInc = note.nco.phaseInc;
+          voice->phase2 = 0;
+          voice->phaseInc2 = note.nco.phaseInc2;
+          voice->samplesLeft = note.nco.samples;
+          voice->level = note.level;
+          voice->peak = note.level;
+          voice->sweep = note.sweep;
+          voice->envelope = note.envelope;
+          if (note.envelope.on) {
+            note.envelope.start(voice->envState);
+            voice->level = (int32_t)(((uint32_t)voice->peak * voice->envState.value) >> 16);
+          }
+          __dmb(); // voice must be complete before the interrupt can see it
+          voice->active = true;
+
+          // Same dance as enqueue(): the interrupt clears active when the
+          // last voice runs out.
+          uint32_t save = save_and_disable_interrupts();
+          if (!_timerData.active) {
+            start_note(note);
+          }
+          restore_interrupts(save);
+          return (int8_t)v;
+        }
+        return -1;
+      }
+
+      bool render_stream(uint32_t *buf) {
+        if (_pcm.data != NULL) {
+          return render_pcm(buf);
+        }
+        if (_engine == TONE_ENGINE_MIXER) {
+          return render_mix(buf);
+        }
+        return render_nco(buf);
+      }
+
+      /// @brief Mix every active voice into one block. The block doubles as
+      /// the int32 accumulator: each voice adds its samples in turn (so its
+      /// state stays in registers), then the sums are clamped to _top and
+      /// turned into CC words in place.
+      /// @return false if no voices are left after this block
+      bool __not_in_flash_func(render_mix)(uint32_t *buf) {
+        int32_t *acc = (int32_t*)buf;
+        for (int i = 0; i < TONE_STREAM_BLOCK; i++) {
+          acc[i] = 0;
+        }
+
+        bool any = false;
+        for (int v = 0; v < TONE_MAX_VOICES; v++) {
+          tone_voice *voice = &_voices[v];
+          if (!voice->active) {
+            continue;
+          }
+          uint32_t run = TONE_STREAM_BLOCK;
+          if (run > voice->samplesLeft) {
+            run = voice->samplesLeft;
+          }
+          if (voice->envelope.on) {
+            uint32_t envelope = voice->envelope.step(voice->envState,
+                                                     voice->samplesLeft / TONE_STREAM_BLOCK);
+            voice->level = (int32_t)(((uint32_t)voice->peak * envelope) >> 16);
+          }
+          if (voice->sweep.on) {
+            voice->phaseInc = voice->sweep.next();
+          }
+          mix_voice(voice, acc, run);
+          voice->samplesLeft -= run;
+          if (voice->samplesLeft == 0) {
+            voice->active = false;
+            note_done(&_timerData, false);
+          } else {
+            any = true;
+          }
+        }
+
+        uint32_t shiftPlus = _nco.shiftPlus;
+        int32_t top = _top;
+        if (_diff) {
+          uint32_t shiftMinus = _nco.shiftMinus;
+          for (int i = 0; i < TONE_STREAM_BLOCK; i++) {
+            int32_t v = acc[i];
+            if (v >= 0) {
+              buf[i] = (uint32_t)(v < top ? v : top) << shiftPlus;
+            } else {
+              buf[i] = (uint32_t)(-v < top ? -v : top) << shiftMinus;
+            }
+          }
+        } else {
+          for (int i = 0; i < TONE_STREAM_BLOCK; i++) {
+            int32_t v = acc[i];
+            buf[i] = (uint32_t)(v < top ? v : top) << shiftPlus;
+          }
+        }
+        return any;
+      }
+
+      /// @brief Add run samples of one voice into the accumulator. Single-
+      /// ended voices add 0..level (like the square wave does on its own),
+      /// differential voices add -level..level.
+      void __not_in_flash_func(mix_voice)(tone_voice *voice, int32_t *acc,
+                                          uint32_t run) {
+        uint32_t phase = voice->phase;
+        uint32_t inc = voice->phaseInc;
+        int32_t level = voice->level;
+
+        if (voice->phaseInc2 != 0) {
+          uint32_t phase2 = voice->phase2;
+          uint32_t inc2 = voice->phaseInc2;
+          const int16_t *table = dual_table();
+          uint32_t tableShift = dual_table_shift();
+          while (run--) {
+            phase += inc;
+            phase2 += inc2;
+            int32_t sample = (table[phase >> tableShift] + table[phase2 >> tableShift]) >> 1;
+            int32_t v = (sample * level) >> 15;
+            *acc++ += _diff ? v : (level + v) >> 1;
+          }
+          voice->phase2 = phase2;
+        } else if (_nco.wave == TONE_WAVE_SQUARE) {
+          int32_t low = _diff ? -level : 0;
+          while (run--) {
+            phase += inc;
+            *acc++ += (phase & 0x80000000u) ? level : low;
+          }
+        } else {
+          const int16_t *table = _nco.table;
+          uint32_t tableShift = _nco.tableShift;
+          while (run--) {
+            phase += inc;
+            int32_t sample;
+            if (table != NULL) {
+              sample = table[phase >> tableShift];
+            } else {
+              int32_t t = (int32_t)(phase >> 16);
+              sample = 2 * (t < 32768 ? t : 65535 - t) - 32767;
+            }
+            int32_t v = (sample * level) >> 15;
+            *acc++ += _diff ? v : (level + v) >> 1;
+          }
+        }
+        voice->phase = phase;
+      }
+
+      static void __not_in_flash_func(nco_dma_cb)(uint channel, void *user_data) {
+        RP2040_Volume *self = (RP2040_Volume*)user_data;
+        if (self->_sink.ring != NULL) {
+          self->sink_dma_cb(channel);
+          return;
+        }
+        uint32_t *buf = self->_streamBuf;
+        if (channel == (uint)self->_dma[1]) {
+          buf += TONE_STREAM_BLOCK;
+        }
+        // Re-arm for when the other channel chains back to this one
+        dma_channel_set_read_addr(channel, buf, false);
+
+        // Keep rendering even once we've run dry, so anything queued while
+        // we drain still gets picked up.
+        if (self->render_stream(buf)) {
+#if TONE_STATS
+          if (self->_nco.drain != 0) {
+            // Ran dry, then more turned up
+            RP2040_Tone_Scheduler::add_underrun(&self->_stats);
+          }
+#endif
+          self->_nco.drain = 0;
+          return;
+        }
+
+        // Out of notes: the partly silent block plays after the one running
+        // now, so stop once both are done.
+        if (++self->_nco.drain > 2) {
+          self->abort_dma();
+          *self->_timerData.cc = 0;
+          self->_pcm.data = NULL; // back to tones for whatever comes next
+          note_done(&self->_timerData, true);
+          self->arm_idle();
+        }
+      }
+
+      /// @brief End of a PIO engine note: the DMA picks up the next note's
+      /// words as it goes round the ring (the FIFO still holds up to two
+      /// half periods of this one), or everything stops with the pins low.
+      static bool __not_in_flash_func(pio_stop_cb)(struct tone_event *event) {
+        RP2040_Volume *self = (RP2040_Volume*)event->user_data;
+        tone_note next;
+        if (self->_queue.pop(next)) {
+          self->_level = next.level;
+          self->load_pio_words(next);
+          event->delay_us = next.durationUs;
+          note_done(&self->_timerData, false);
+          return true;
+        }
+        self->abort_dma();
+        self->park_pio();
+        note_done(&self->_timerData, true);
+        idle_from_callback(&self->_timerData);
+        return false; // don't reschedule
+      }
+
+      static bool __not_in_flash_func(dma_stop_cb)(struct tone_event *event) {
+        RP2040_Volume *self = (RP2040_Volume*)event->user_data;
+        tone_note next;
+        if (self->_queue.pop(next)) {
+          // The DMA keeps running. The half playing now reads the current
+          // pair to its end; the new words go in the other pair and the new
+          // length is reloaded, and _dma[1] hands _dma[0] the new pair's
+          // address when it next restarts it, so both switch on the same
+          // half period boundary.
+          self->_level = next.level;
+          uint32_t *words = self->_ccWords[self->_ccPair ^ 1];
+          words[0] = next.ccWords[0];
+          words[1] = next.ccWords[1];
+          dma_hw->ch[self->_dma[0]].transfer_count = next.dma.halfCarriers;
+          self->_ccWordAddrs[0] = &words[0];
+          self->_ccWordAddrs[1] = &words[1];
+          self->_ccPair ^= 1;
+          // Measured from when this one was due, so notes don't drift
+          event->delay_us = next.durationUs;
+          note_done(&self->_timerData, false);
+          return true;
+        }
+        self->abort_dma();
+        // 0% duty cycle, but leave running so they go to low correctly
+        *self->_timerData.cc = 0;
+        note_done(&self->_timerData, true);
+        idle_from_callback(&self->_timerData);
+        return false; // don't reschedule
+      }
+
+};
+
+/// @brief Plays the same note on several RP2040_Volume instances in lock step.
+/// Every member's slice is configured with its outputs disabled, their
+/// counters are reset together and they are all enabled by a single
+/// pwm_set_mask_enabled(), so the carriers are phase-aligned. The timer engine
+/// edges of every member are scheduled from the same start time and period,
+/// so they stay on identical deadlines and are serviced by the same scheduler
+/// interrupt; the DMA-paced engines stay locked because their slices wrap on
+/// the same clock. Members must be on different slices and run on the core
+/// calling the group (not TONE_ON_CORE1). The mixer and PIO engines aren't
+/// supported.
+class RP2040_Tone_Group {
+    public:
+      /// @brief Add a member
+      /// @return false if the group is full or the member can't be grouped
+      bool add(RP2040_Volume &member) {
+        if (_count >= TONE_GROUP_MAX_MEMBERS || member._core1 ||
+            member._engine == TONE_ENGINE_MIXER || member._engine == TONE_ENGINE_PIO) {
+          return false;
+        }
+        _members[_count++] = &member;
+        _sliceMask |= 1u << member._sliceNum;
+        return true;
+      }
+
+      /// @brief tone_fixed() on every member, started at the same instant.
+      /// Replaces whatever they were playing.
+      /// @param freq_mHz Frequency in milli-Hertz (440 Hz = 440000)
+      /// @param level_permille Volume in tenths of a percent (0-1000)
+      /// @param duration_us Duration in microseconds
+      void tone_fixed(uint32_t freq_mHz, uint16_t level_permille, uint32_t duration_us) {
+        play(freq_mHz, 0, level_permille, duration_us);
+      }
+
+      /// @brief tone_midi() on every member, started at the same instant
+      void tone_midi(uint8_t note, uint16_t level_permille, uint32_t duration_us) {
+        note &= 0x7f;
+        play(TONE_MIDI_TABLE.freq_mHz[note], TONE_MIDI_TABLE.halfPeriodUs[note],
+             level_permille, duration_us);
+      }
+
+      /// @brief stop_tone() on every member
+      void stop_tone() {
+        for (uint8_t i = 0; i < _count; i++) {
+          _members[i]->stop_tone();
+        }
+      }
+
+    private:
+      RP2040_Volume *_members[TONE_GROUP_MAX_MEMBERS];
+      uint8_t        _count = 0;
+      uint32_t       _sliceMask = 0;
+
+      void play(uint32_t freq_mHz, uint32_t usPerWave, uint16_t level_permille,
+                uint32_t duration_us) {
+        tone_note notes[TONE_GROUP_MAX_MEMBERS];
+        RP2040_Tone_Scheduler::hold_isr_commands(true);
+        for (uint8_t i = 0; i < _count; i++) {
+          RP2040_Volume *member = _members[i];
+          member->halt_engine();
+          member->_queue.clear();
+          notes[i] = member->make_note(member->make_request(freq_mHz, usPerWave,
+                                                            level_permille,
+                                                            duration_us));
+          member->configure_note(notes[i]);
+        }
+
+        uint32_t save = save_and_disable_interrupts();
+        for (uint8_t i = 0; i < _count; i++) {
+          pwm_set_counter(_members[i]->_sliceNum, 0);
+        }
+        // Slices outside the group keep whatever state they were in
+        pwm_set_mask_enabled(pwm_hw->en | _sliceMask);
+        uint64_t start = time_us_64();
+        for (uint8_t i = 0; i < _count; i++) {
+          _members[i]->schedule_note(notes[i], start);
+        }
+        restore_interrupts(save);
+        RP2040_Tone_Scheduler::hold_isr_commands(false);
+      }
+};
+
+/// @brief Static home for RP2040_Volume instances, so nothing needs the heap:
+/// open() constructs one in place in a table of TONE_MAX_CHANNELS slots sized
+/// at compile time, and close() destroys it and frees the slot. A slot holds
+/// the per-note and per-edge state (about 2 KB, most of it the note queue);
+/// stream buffers, sink rings and mixer voices come from their own pools, so
+/// only the instances that use them pay for them. The table is walked
+/// linearly by stop_all() and at(). Thread code only, like the constructor.
+class RP2040_Tone_Channels {
+    public:
+      /// @brief Construct a channel in a free slot, same arguments as the
+      /// RP2040_Volume constructor
+      /// @return NULL if every slot is taken
+      static RP2040_Volume *open(uint8_t pin_plus, uint8_t pin_minus = 255,
+                                 uint8_t engine = TONE_ENGINE_TIMER) {
+        for (uint8_t i = 0; i < TONE_MAX_CHANNELS; i++) {
+          if ((_used() & (1u << i)) == 0) {
+            _used() |= 1u << i;
+            return new (slot(i)) RP2040_Volume(pin_plus, pin_minus, engine);
+          }
+        }
+        return NULL;
+      }
+
+      /// @brief Stop and destroy a channel from open(), freeing its slot
+      static void close(RP2040_Volume *channel) {
+        for (uint8_t i = 0; i < TONE_MAX_CHANNELS; i++) {
+          if ((_used() & (1u << i)) != 0 && at(i) == channel) {
+            channel->~RP2040_Volume();
+            _used() &= ~(1u << i);
+            return;
+          }
+        }
+      }
+
+      /// @brief The channel in slot i
+      /// @return NULL if the slot is free
+      static RP2040_Volume *at(uint8_t i) {
+        if (i >= TONE_MAX_CHANNELS || (_used() & (1u << i)) == 0) {
+          return NULL;
+        }
+        return slot(i);
+      }
+
+      /// @brief Channels open right now
+      static uint8_t count() {
+        return (uint8_t)__builtin_popcount(_used());
+      }
+
+      /// @brief stop_tone() on every open channel
+      static void stop_all() {
+        for (uint8_t i = 0; i < TONE_MAX_CHANNELS; i++) {
+          if ((_used() & (1u << i)) != 0) {
+            slot(i)->stop_tone();
+          }
+        }
+      }
+
+    private:
+      static_assert(TONE_MAX_CHANNELS >= 1 && TONE_MAX_CHANNELS <= 32,
+                    "TONE_MAX_CHANNELS must be 1-32");
+
+      static uint32_t &_used() {
+        static uint32_t s_used = 0;
+        return s_used;
+      }
+
+      static RP2040_Volume *slot(uint8_t i) {
+        alignas(RP2040_Volume) static uint8_t s_slots[TONE_MAX_CHANNELS][sizeof(RP2040_Volume)];
+        return (RP2040_Volume*)s_slots[i];
+      }
+};
+
+/// @brief Compile-time configured variant of RP2040_Volume for when the pins
+/// are known up front. The same-slice requirement is checked with a
+/// static_assert, and the per-edge callback is specialised for the topology
+/// with the CC register address folded to a constant. Otherwise behaves (and
+/// can be used) exactly like RP2040_Volume.
+/// @tparam PinPlus GPIO Pin number for + lead
+/// @tparam PinMinus GPIO Pin number for - lead, 255 for single-ended
+/// @tparam Resolution Volume steps (the slice's TOP), range checked at
+/// compile time
+template <uint8_t PinPlus, uint8_t PinMinus = 255, uint16_t Resolution = TOP>
+class RP2040_VolumeT : public RP2040_Volume {
+    public:
+      static constexpr bool    DIFF = PinMinus != 255;
+      static constexpr uint8_t SLICE = (PinPlus >> 1) & 7;
+
+      static_assert(PinPlus < NUM_BANK0_GPIOS, "PinPlus is not a GPIO");
+      static_assert(!DIFF || PinMinus < NUM_BANK0_GPIOS, "PinMinus is not a GPIO");
+      static_assert(!DIFF || PinMinus != PinPlus, "PinPlus and PinMinus must differ");
+      static_assert(!DIFF || ((PinMinus >> 1) & 7) == SLICE,
+                    "Differential pins must be on the same PWM slice");
+      static_assert(Resolution >= 1 && Resolution <= 65534,
+                    "Resolution must be 1-65534");
+
+      /// @param engine TONE_ENGINE_TIMER or TONE_ENGINE_DMA
+      /// @param carrier_hz Carrier frequency, 0 for the fastest Resolution
+      /// allows (see set_carrier())
+      RP2040_VolumeT(uint8_t engine = TONE_ENGINE_TIMER, uint32_t carrier_hz = 0)
+          : RP2040_Volume(PinPlus, PinMinus, engine) {
+        _timerCb = timer_cb;
+        if (carrier_hz != 0 || Resolution != TOP) {
+          set_carrier(carrier_hz, Resolution);
+        }
+      }
+
+    private:
+      static bool __not_in_flash_func(timer_cb)(struct tone_event *data) {
+        struct timer_data *tData = (timer_data*)(data->user_data);
+        if (++tData->repeats >= tData->numRepeats) {
+          return next_note(data, tData);
+        }
+
+        tData->high ^= 1;
+        if (tData->high == 0 && (tData->envelope.on || tData->sweep.on)) {
+          next_period(data, tData);
+        }
+        if (DIFF) {
+          pwm_hw->slice[SLICE].cc = tData->ccWords[tData->high];
+        } else {
+          // The low half of a single-ended wave is always 0
+          pwm_hw->slice[SLICE].cc = tData->ccWords[1] & (0u - tData->high);
+        }
+
+        return true;
+      }
 };
 
 #endif
@@ -0,0 +1,134 @@
+/*
+Stress test for sizing a design: for each backend (alarm-driven timer, DMA and
+PIO engines) it ramps the number of speakers, the tone frequency and how often
+the notes change, while loop() keeps a background workload busy, and prints a
+line per configuration over USB serial:
+
+  engine speakers freq_Hz note_us load_% work_% late_max_us late dropped
+
+load_% is the time spent in the library's interrupts (SysTick cycles from
+get_stats()), work_% how much of the background workload still got done
+compared to running it with no audio at all, so it includes the cost of
+keeping the queues topped up. late counts callbacks more than
+TONE_STATS_LATE_US behind their deadline. A configuration breaks once an edge
+is dropped or an edge lands more than a quarter of a half period late; the
+ramp for that backend stops at the first one.
+
+Put a scope or a logic analyser on the pins rather than speakers: up to eight
+outputs run at once, GPIO 0, 2, 4 ... 14 (one PWM slice each).
+*/
+#define TONE_STATS 1 // before the include, get_stats() reads zeros otherwise
+#include <Arduino.h>
+#include "RP2040_Volume.h"
+
+#define MAX_SPEAKERS 8   // one per PWM slice, within TONE_MAX_CHANNELS
+#define RUN_MS       500 // per configuration
+
+static const uint8_t ENGINES[] = {TONE_ENGINE_TIMER, TONE_ENGINE_DMA, TONE_ENGINE_PIO};
+static const char *const ENGINE_NAMES[] = {"timer", "dma", "pio"};
+// The DMA engine takes two of the 12 DMA channels per speaker
+static const uint8_t ENGINE_MAX[] = {MAX_SPEAKERS, 6, MAX_SPEAKERS};
+
+static const uint32_t FREQS_MHZ[] = {110000, 440000, 1760000, 5000000, 10000000, 20000000};
+static const uint32_t NOTE_US[] = {100000, 10000, 1000};
+
+RP2040_Volume *speakers[MAX_SPEAKERS];
+volatile uint32_t workResult; // keeps the workload from being optimised out
+uint32_t baseline;             // workload chunks in RUN_MS with no audio
+
+/// @brief One chunk of the background workload
+static void work_chunk() {
+  uint32_t x = workResult;
+  for (int i = 0; i < 1000; i++) {
+    x = x * 1664525u + 1013904223u;
+  }
+  workResult = x;
+}
+
+/// @brief Keep every speaker's queue full, alternating between two pitches
+/// so each queued note is a real change
+static void top_up(uint8_t count, uint32_t freq_mHz, uint32_t note_us, bool *high) {
+  for (uint8_t i = 0; i < count; i++) {
+    while (speakers[i]->enqueue_fixed(high[i] ? freq_mHz + freq_mHz / 64 : freq_mHz,
+                                      500, note_us)) {
+      high[i] = !high[i];
+    }
+  }
+}
+
+/// @brief Run one configuration and print its line
+/// @return false if timing broke down
+static bool run(uint8_t engine, uint8_t count, uint32_t freq_mHz, uint32_t note_us) {
+  for (uint8_t i = 0; i < count; i++) {
+    speakers[i] = RP2040_Tone_Channels::open(2 * i, 255, ENGINES[engine]);
+  }
+  bool high[MAX_SPEAKERS] = {};
+  RP2040_Tone_Scheduler::reset_stats();
+  top_up(count, freq_mHz, note_us, high);
+
+  uint32_t start = millis();
+  uint32_t chunks = 0;
+  while (millis() - start < RUN_MS) {
+    work_chunk();
+    chunks++;
+    top_up(count, freq_mHz, note_us, high);
+  }
+  tone_stats stats = RP2040_Tone_Scheduler::get_stats();
+  uint64_t elapsedUs = time_us_64() - stats.sinceUs;
+
+  for (uint8_t i = 0; i < count; i++) {
+    // Stops it and gives back its slice, DMA and SM
+    RP2040_Tone_Channels::close(speakers[i]);
+  }
+
+  // cycles / (clk_sys * s), in hundredths of a percent
+  uint64_t load = stats.cycles * 10000ull * 1000000ull /
+                  ((uint64_t)clock_get_hz(clk_sys) * elapsedUs);
+  uint32_t work = (uint32_t)((uint64_t)chunks * 10000 / baseline);
+  uint32_t halfPeriodUs = 500000000u / freq_mHz;
+  bool broke = stats.dropped != 0 || stats.lateMaxUs * 4 > halfPeriodUs;
+
+  char line[128];
+  snprintf(line, sizeof(line), "%-6s %8u %7lu %7lu %3u.%02u %3lu.%02lu %11lu %4lu %7lu%s",
+           ENGINE_NAMES[engine], count, (unsigned long)(freq_mHz / 1000),
+           (unsigned long)note_us, (unsigned)(load / 100), (unsigned)(load % 100),
+           (unsigned long)(work / 100), (unsigned long)(work % 100),
+           (unsigned long)stats.lateMaxUs, (unsigned long)stats.late,
+           (unsigned long)stats.dropped, broke ? "  <- breaks" : "");
+  Serial.println(line);
+  return !broke;
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) {
+    delay(10);
+  }
+  delay(1000); // see the README note on tones straight after a reset
+
+  uint32_t start = millis();
+  baseline = 0;
+  while (millis() - start < RUN_MS) {
+    work_chunk();
+    baseline++;
+  }
+  Serial.println("engine speakers freq_Hz note_us load_% work_% late_max_us late dropped");
+}
+
+void loop() {
+  for (uint8_t engine = 0; engine < sizeof(ENGINES); engine++) {
+    bool ok = true;
+    for (uint8_t count = 1; ok && count <= ENGINE_MAX[engine]; count++) {
+      for (uint8_t f = 0; ok && f < sizeof(FREQS_MHZ) / sizeof(FREQS_MHZ[0]); f++) {
+        for (uint8_t n = 0; ok && n < sizeof(NOTE_US) / sizeof(NOTE_US[0]); n++) {
+          ok = run(engine, count, FREQS_MHZ[f], NOTE_US[n]);
+        }
+      }
+    }
+    Serial.println();
+  }
+  Serial.println("done");
+  for (;;) {
+    delay(1000);
+  }
+}
@@ -3,7 +3,8 @@ Example Code for using the library, it (roughly) mimics the standard
 tone() function.
 
 Tones generated by this library way are non-blocking, so if you want to play a song
-or something you need to manually block between calls.
+or something either block between tone() calls or queue the notes with
+enqueue_tone() and let the library play them back to back.
 */
 #include <Arduino.h> // Not strictly required, the library itself is based entirely on
                      // Pico SDK functions and does not depend on Arduino at all
@@ -12,15 +13,19 @@ or something you need to manually block between calls.
 #define SPK_PIN_PLUS    6
 #define SPK_PIN_MINUS   7 // Must be same PWM slice as SPK_PIN_PLUS
 
-//#define TONE_ALARM_POOL_HARDWARE_ALARM_NUM XXX // Only needed if you're using the default hardware
-                                                 // alarm pool for something already
+//#define TONE_ALARM_POOL_HARDWARE_ALARM_NUM XXX // Only needed if you're using hardware alarm 3
+                                                 // for something already (it is shared by all instances)
 
 
 RP2040_Volume* vol;
 
 void setup() {
-  vol = new RP2040_Volume(SPK_PIN_PLUS); // For single-ended audio
-  //vol = new RP2040_Volume(SPK_PIN_PLUS, SPK_PIN_MINUS); // For differential audio
+  // Constructed in a static slot (no heap), `new RP2040_Volume(...)` works too
+  vol = RP2040_Tone_Channels::open(SPK_PIN_PLUS); // For single-ended audio
+  //vol = RP2040_Tone_Channels::open(SPK_PIN_PLUS, SPK_PIN_MINUS); // For differential audio
+  //vol = RP2040_Tone_Channels::open(SPK_PIN_PLUS, 255, TONE_ENGINE_DMA); // No per-edge interrupts
+  //vol = RP2040_Tone_Channels::open(SPK_PIN_PLUS, 255, TONE_ENGINE_NCO | TONE_ON_CORE1);
+  //RP2040_Tone_Core1::launch(); // All audio interrupts then run on core 1
 }
 
 void loop() {
@@ -30,4 +35,12 @@ void loop() {
   vol->stop_tone(); // Stops the currently-playing tone, not required --
                     // tone will stop automatically if given time to play
   delay(1000);
+
+  // Queued notes play back to back without any blocking here
+  vol->enqueue_tone(523.25, 25, 150);
+  vol->enqueue_rest(50);
+  vol->enqueue_tone(659.25, 25, 150);
+  vol->enqueue_tone(783.99, 25, 300);
+  vol->wait_done(); // Sleeps until the last queued note has finished
+  delay(350);
 }
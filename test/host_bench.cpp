@@ -0,0 +1,1001 @@
+/*
+Host regression and benchmark program for RP2040_Volume.h, built against the
+simulated SDK in mock/. It drives each engine through the public API only and
+checks what the README promises:
+
+  - the timer engine's half period is the rounded microsecond from 7.5 Hz to
+    20 kHz, both from tone() and tone_fixed(), and notes end within a half
+    period (counting) or on the microsecond (set_deadline_timing())
+  - the DMA and PIO engines pick the nearest whole number of carrier periods
+    per half period and end notes exactly on their deadline
+  - the NCO and mixer engines' rendered streams are within a sample's worth
+    of the requested frequency and duration
+  - write() fills the sink ring in order round its end, underruns are counted,
+    and PCM words scale by level and bit depth as pcm_word() documents
+  - envelopes, linear and exponential sweeps, dial gaps, set_frequency()
+    mid-note, idle wake-up and play(patch) land where their docs say
+  - nothing allocates: constructing, playing, queueing and destroying every
+    engine goes through operator new and malloc zero times
+
+and prints the instance size and the host cost of tone() and of one timer
+engine callback. Those numbers are for spotting regressions between builds on
+the same machine; example/benchmark gives the real on-target figures. Exits
+non-zero on any failed check.
+*/
+#include "RP2040_Volume.h"
+#include <chrono>
+#include <math.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+static int g_failures;
+static volatile unsigned long g_allocs;
+
+#define CHECK(cond, ...)                                    \
+  do {                                                      \
+    if (!(cond)) {                                          \
+      g_failures++;                                         \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__);           \
+      printf(__VA_ARGS__);                                  \
+      printf("\n");                                         \
+    }                                                       \
+  } while (0)
+
+// Allocation counting. operator new covers C++ code, and with glibc malloc
+// itself is wrapped so C-style allocations are caught too. The deletes stay
+// out of line, or GCC sees free() on operator new's pointer and warns.
+void *operator new(size_t size) {
+  g_allocs++;
+  void *p = malloc(size);
+  if (p == NULL) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+  free(p);
+}
+__attribute__((noinline)) void operator delete[](void *p) noexcept {
+  free(p);
+}
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+__attribute__((noinline)) void operator delete[](void *p, size_t) noexcept {
+  free(p);
+}
+
+#if defined(__GLIBC__)
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+extern "C" void *malloc(size_t size) noexcept {
+  g_allocs++;
+  return __libc_malloc(size);
+}
+extern "C" void *calloc(size_t count, size_t size) noexcept {
+  g_allocs++;
+  return __libc_calloc(count, size);
+}
+extern "C" void *realloc(void *p, size_t size) noexcept {
+  g_allocs++;
+  return __libc_realloc(p, size);
+}
+#endif
+
+#define PIN 0   // GPIO 0: slice 0, channel A
+#define SLICE 0
+
+static const char *engine_name(uint8_t engine) {
+  static const char *const names[] = {"timer", "dma", "nco", "mixer", "pio"};
+  return names[engine];
+}
+
+/// @brief Log-spaced test frequencies from 7.5 Hz to 20 kHz, in milli-Hertz
+static std::vector<uint32_t> sweep_mhz() {
+  const int points = 24;
+  std::vector<uint32_t> freqs;
+  for (int i = 0; i < points; i++) {
+    double hz = 7.5 * pow(20000.0 / 7.5, (double)i / (points - 1));
+    freqs.push_back((uint32_t)llround(hz * 1000.0));
+  }
+  return freqs;
+}
+
+static double ideal_half_us(uint32_t freq_mHz) {
+  return 500000000.0 / freq_mHz;
+}
+
+// Timer and scheduler driven engines ------------------------------------------
+
+struct edge_log {
+  uint64_t start, end;  // tone() and the end of the note
+  uint64_t first, last; // first and last edge while playing
+  uint32_t edges;
+};
+
+/// @brief Run alarms until the note ends, logging the slice's CC changes
+static edge_log run_edges(RP2040_Volume &speaker) {
+  edge_log log = {};
+  log.start = mock_now();
+  uint32_t cc = pwm_hw->slice[SLICE].cc;
+  while (speaker.is_playing() && mock_step()) {
+    if (pwm_hw->slice[SLICE].cc != cc && speaker.is_playing()) {
+      if (log.edges++ == 0) {
+        log.first = mock_now();
+      }
+      log.last = mock_now();
+    }
+    cc = pwm_hw->slice[SLICE].cc;
+  }
+  log.end = mock_now();
+  return log;
+}
+
+static void check_timer_frequency() {
+  for (uint32_t freq : sweep_mhz()) {
+    double ideal = ideal_half_us(freq);
+    uint64_t duration = (uint64_t)(ideal * 40) > 100000 ? (uint64_t)(ideal * 40) : 100000;
+    for (int fixed = 0; fixed < 2; fixed++) {
+      RP2040_Volume speaker(PIN);
+      if (fixed) {
+        speaker.tone_fixed(freq, 500, duration);
+      } else {
+        speaker.tone_us(freq / 1000.0f, 50, duration);
+      }
+      edge_log log = run_edges(speaker);
+      CHECK(log.edges >= 2, "timer %s %.3f Hz: %u edges", fixed ? "tone_fixed" : "tone",
+            freq / 1000.0, log.edges);
+      if (log.edges < 2) {
+        continue;
+      }
+      double half = (double)(log.last - log.first) / (log.edges - 1);
+      CHECK(fabs(half - ideal) <= 0.5 + 1e-3, "timer %s %.3f Hz: half period %.3f us, want %.3f",
+            fixed ? "tone_fixed" : "tone", freq / 1000.0, half, ideal);
+    }
+  }
+}
+
+static void check_timer_duration() {
+  static const uint32_t freqs[] = {7500, 440000, 20000000};
+  static const uint64_t durations[] = {1000, 37000, 123457, 1000000, 4321000};
+  for (uint32_t freq : freqs) {
+    for (uint64_t duration : durations) {
+      for (int deadline = 0; deadline < 2; deadline++) {
+        RP2040_Volume speaker(PIN);
+        speaker.set_deadline_timing(deadline != 0);
+        speaker.tone_fixed(freq, 500, duration);
+        edge_log log = run_edges(speaker);
+        int64_t error = (int64_t)(log.end - log.start) - (int64_t)duration;
+        if (deadline) {
+          CHECK(error == 0, "timer deadline %.3f Hz %llu us: off by %lld us", freq / 1000.0,
+                (unsigned long long)duration, (long long)error);
+        } else {
+          CHECK(llabs(error) <= (int64_t)ceil(ideal_half_us(freq)),
+                "timer counting %.3f Hz %llu us: off by %lld us", freq / 1000.0,
+                (unsigned long long)duration, (long long)error);
+        }
+      }
+    }
+  }
+}
+
+/// @brief Find the claimed channel writing to addr
+static int find_channel(volatile void *addr) {
+  for (uint ch = 0; ch < NUM_DMA_CHANNELS; ch++) {
+    const mock_dma_channel_t *c = mock_dma_channel(ch);
+    if (c->claimed && c->started && c->write_addr == addr) {
+      return (int)ch;
+    }
+  }
+  return -1;
+}
+
+/// @brief DMA and PIO engines: carrier periods per half period, and the end
+/// of the note on its deadline
+static void check_carrier_engine(uint8_t engine) {
+  for (uint32_t freq : sweep_mhz()) {
+    RP2040_Volume speaker(PIN, 255, engine);
+    uint32_t carrier = speaker.set_carrier(0);
+    uint64_t duration = 250000;
+    speaker.tone_fixed(freq, 500, duration);
+    uint64_t start = mock_now();
+
+    uint32_t halfCarriers = 0;
+    if (engine == TONE_ENGINE_DMA) {
+      CHECK(mock_pwm_carrier_mhz(SLICE) == carrier, "dma: slice runs at %u mHz, want %u",
+            mock_pwm_carrier_mhz(SLICE), carrier);
+      int ch = find_channel(&pwm_hw->slice[SLICE].cc);
+      CHECK(ch >= 0, "dma %.3f Hz: no channel on the slice", freq / 1000.0);
+      if (ch >= 0) {
+        halfCarriers = mock_dma_channel(ch)->transfer_count;
+      }
+    } else {
+      int ch = find_channel(&mock_pio[0].txf[0]);
+      CHECK(ch >= 0, "pio %.3f Hz: no channel on the FIFO", freq / 1000.0);
+      if (ch >= 0) {
+        halfCarriers = ((const uint32_t*)mock_dma_channel(ch)->read_addr)[0] + 1;
+      }
+    }
+    double carrierUs = 1e9 / carrier;
+    double error = halfCarriers * carrierUs - ideal_half_us(freq);
+    CHECK(fabs(error) <= carrierUs / 2 + 1e-6,
+          "%s %.3f Hz: %u carrier periods is %.3f us off the half period",
+          engine_name(engine), freq / 1000.0, halfCarriers, error);
+
+    while (speaker.is_playing() && mock_step()) {
+    }
+    CHECK(mock_now() - start == duration, "%s %.3f Hz: note lasted %llu us, want %llu",
+          engine_name(engine), freq / 1000.0, (unsigned long long)(mock_now() - start),
+          (unsigned long long)duration);
+  }
+}
+
+/// @brief A queued DMA engine note goes into the other pair of CC words, so
+/// the half period playing at the hand-off keeps its level, and _dma[1] hands
+/// _dma[0] the new pair and length together on the next restart
+static void check_dma_handoff() {
+  RP2040_Volume speaker(PIN, 255, TONE_ENGINE_DMA);
+  uint32_t carrier = speaker.set_carrier(0);
+  speaker.tone_fixed(440000, 500, 10000);
+  speaker.enqueue_fixed(1000000, 250, 10000);
+  int ch0 = find_channel(&pwm_hw->slice[SLICE].cc);
+  int ch1 = ch0 >= 0 ? mock_dma_channel((uint)ch0)->config.chain_to : -1;
+  CHECK(ch0 >= 0 && ch1 >= 0, "dma hand-off: no channel pair on the slice");
+  if (ch0 < 0 || ch1 < 0) {
+    return;
+  }
+  // _dma[1] reads the second of the two word addresses first
+  const uint32_t *const *addrs = (const uint32_t *const *)mock_dma_channel((uint)ch1)->read_addr - 1;
+  const uint32_t *playing = (const uint32_t *)mock_dma_channel((uint)ch0)->read_addr;
+  uint32_t oldLow = playing[0];
+  uint32_t oldHigh = addrs[1][0];
+
+  mock_step(); // the first note's end
+  uint32_t want = (carrier + 1000000) / (2 * 1000000);
+  CHECK(playing[0] == oldLow && playing[1] == oldHigh && addrs[0] != playing,
+        "dma hand-off: the playing half's words were overwritten");
+  CHECK(addrs[0][0] == oldLow && addrs[1][0] != oldHigh,
+        "dma hand-off: new pair holds %08x/%08x, was %08x/%08x", addrs[0][0], addrs[1][0],
+        oldLow, oldHigh);
+  CHECK(mock_dma_channel((uint)ch0)->transfer_count == want,
+        "dma hand-off: reload is %u carrier periods, want %u",
+        mock_dma_channel((uint)ch0)->transfer_count, want);
+  speaker.stop_tone();
+}
+
+// Streaming engines -----------------------------------------------------------
+
+/// @brief Play the two DMA channels' blocks in turn, roughly in real time,
+/// until the engine stops
+/// @param samples Every CC word that went to the slice, NULL to not keep them
+/// @param hook Called after each block with the samples played so far
+static void run_stream(RP2040_Volume &speaker, uint32_t carrier_mHz,
+                       std::vector<uint32_t> *samples,
+                       void (*hook)(RP2040_Volume &, uint64_t) = NULL) {
+  int ch = find_channel(&pwm_hw->slice[SLICE].cc);
+  CHECK(ch >= 0, "stream: no channel on the slice");
+  uint64_t start = mock_now();
+  uint64_t played = 0;
+  while (ch >= 0 && speaker.is_playing() && played < 100000000u) {
+    const mock_dma_channel_t *c = mock_dma_channel((uint)ch);
+    const uint32_t *block = (const uint32_t*)c->read_addr;
+    if (samples != NULL) {
+      samples->insert(samples->end(), block, block + c->transfer_count);
+    }
+    played += c->transfer_count;
+    uint64_t due = start + (uint64_t)(played * 1e9 / carrier_mHz);
+    mock_advance(due - mock_now());
+    mock_dma_complete((uint)ch);
+    ch = c->config.chain_to;
+    if (hook != NULL) {
+      hook(speaker, played);
+    }
+  }
+}
+
+/// @param resolution Slice TOP, which sets the carrier (50 is over 1 MHz)
+static void check_stream_engine(uint8_t engine, uint16_t resolution, uint64_t duration) {
+  for (uint32_t freq : sweep_mhz()) {
+    RP2040_Volume speaker(PIN, 255, engine);
+    uint32_t carrier = speaker.set_carrier(0, resolution);
+    speaker.tone_fixed(freq, 500, duration);
+    std::vector<uint32_t> samples;
+    run_stream(speaker, carrier, &samples);
+
+    // Rising edges of the square wave (the end of the note is a falling one
+    // part way through a half), and the last sample of the note
+    size_t first = 0, last = 0, rises = 0, lastHigh = 0;
+    for (size_t i = 1; i < samples.size(); i++) {
+      if (samples[i] != 0 && samples[i - 1] == 0) {
+        if (rises++ == 0) {
+          first = i;
+        }
+        last = i;
+      }
+      if (samples[i] != 0) {
+        lastHigh = i;
+      }
+    }
+    CHECK(rises >= 2, "%s %.3f Hz: %zu periods", engine_name(engine), freq / 1000.0, rises);
+    if (rises < 2) {
+      continue;
+    }
+    double carrierHz = carrier / 1000.0;
+    double measured = (rises - 1) * carrierHz / (double)(last - first);
+    // Each edge lands on a whole sample, and the phase step is truncated
+    // twice (the 2^48 / carrier scale, then Q16 milli-Hertz)
+    double allowed = measured / (double)(last - first) +
+                     freq / 1000.0 * carrier / 281474976710656.0 + carrierHz / 4294967296.0;
+    CHECK(fabs(measured - freq / 1000.0) <= allowed && fabs(measured - freq / 1000.0) < 1.0,
+          "%s %.3f Hz: rendered %.4f Hz", engine_name(engine), freq / 1000.0, measured);
+
+    // The note's last high half ends within a half period of the duration
+    double endSamples = duration * carrierHz / 1e6;
+    double halfSamples = ideal_half_us(freq) * carrierHz / 1e6;
+    CHECK(lastHigh + 1 <= endSamples + 1 && lastHigh + 1 >= endSamples - halfSamples - 1,
+          "%s %.3f Hz: last high sample %zu, note is %.1f samples", engine_name(engine),
+          freq / 1000.0, lastHigh, endSamples);
+  }
+}
+
+// Features --------------------------------------------------------------------
+
+/// @brief CC word a single-ended pin 0 gets for a PCM sample at full-scale
+/// level scale
+static uint32_t pcm_expect(int32_t sample, uint32_t scale) {
+  return ((uint32_t)(sample + 32768) * scale) >> 16;
+}
+
+/// @brief begin_stream()/write(): the ring's free space, the DMA taking
+/// whole blocks out of it in order, silence and an underrun once less than a
+/// block is left, and write() never taking more than fits
+static void check_sink() {
+  const uint32_t size = TONE_SINK_BLOCKS * TONE_STREAM_BLOCK;
+  RP2040_Volume speaker(PIN, 255, TONE_ENGINE_NCO);
+  CHECK(speaker.available() == 0, "sink: %zu free before begin_stream()", speaker.available());
+  CHECK(speaker.begin_stream(8000), "sink: begin_stream() refused");
+  CHECK(speaker.available() == size - 1, "sink: %zu free in an empty ring, want %u",
+        speaker.available(), size - 1);
+
+  std::vector<int16_t> pcm(300);
+  for (size_t i = 0; i < pcm.size(); i++) {
+    pcm[i] = (int16_t)(i * 200 - 30000);
+  }
+  CHECK(speaker.write(pcm.data(), pcm.size()) == pcm.size(), "sink: short write");
+  CHECK(speaker.available() == size - 301, "sink: %zu free after 300, want %u",
+        speaker.available(), size - 301);
+
+  int ch0 = find_channel(&pwm_hw->slice[SLICE].cc);
+  int ch1 = ch0 >= 0 ? mock_dma_channel((uint)ch0)->config.chain_to : -1;
+  CHECK(ch0 >= 0 && ch1 >= 0, "sink: no channel pair on the slice");
+  if (ch0 < 0 || ch1 < 0) {
+    return;
+  }
+  const void *silence = (const void *)mock_dma_channel((uint)ch0)->read_addr;
+
+  // Both start on silence: each completion moves a channel onto the next
+  // full block
+  mock_dma_complete((uint)ch0);
+  const uint32_t *first = (const uint32_t *)mock_dma_channel((uint)ch0)->read_addr;
+  mock_dma_complete((uint)ch1);
+  const uint32_t *second = (const uint32_t *)mock_dma_channel((uint)ch1)->read_addr;
+  CHECK(first != silence && second == first + TONE_STREAM_BLOCK,
+        "sink: blocks handed out at %p and %p", (const void *)first, (const void *)second);
+  bool same = first != silence;
+  for (size_t i = 0; same && i < 2 * TONE_STREAM_BLOCK; i++) {
+    same = first[i] == pcm_expect(pcm[i], TOP);
+  }
+  CHECK(same, "sink: ring words don't match the samples written");
+  CHECK(speaker.stream_underruns() == 0, "sink: %u underruns with blocks ready",
+        speaker.stream_underruns());
+
+  // 44 samples left: ch0's block goes back to write() and it idles
+  mock_dma_complete((uint)ch0);
+  CHECK(mock_dma_channel((uint)ch0)->read_addr == silence && speaker.stream_underruns() == 1,
+        "sink: %u underruns after running short, want 1", speaker.stream_underruns());
+  CHECK(speaker.available() == size - 301 + TONE_STREAM_BLOCK,
+        "sink: %zu free once a block played, want %u", speaker.available(),
+        size - 301 + TONE_STREAM_BLOCK);
+
+  // Keep a block ahead for twice round the ring: every block comes off it,
+  // in order, wrapping at the end
+  const uint32_t *ring = first;
+  int ch = ch1;
+  uint32_t at = 2 * TONE_STREAM_BLOCK;
+  size_t steady = speaker.available();
+  bool wrapped = true;
+  for (uint32_t k = 0; k < 2 * TONE_SINK_BLOCKS; k++) {
+    std::vector<int16_t> block(TONE_STREAM_BLOCK, (int16_t)(k * 1000));
+    CHECK(speaker.write(block.data(), block.size()) == block.size(), "sink: lap %u refused", k);
+    mock_dma_complete((uint)ch);
+    wrapped = wrapped && mock_dma_channel((uint)ch)->read_addr == ring + at;
+    at = (at + TONE_STREAM_BLOCK) % size;
+    ch = mock_dma_channel((uint)ch)->config.chain_to;
+  }
+  // The idle channel's first block released nothing; the rest each freed one
+  wrapped = wrapped && speaker.available() == steady - TONE_STREAM_BLOCK;
+  CHECK(wrapped && speaker.stream_underruns() == 1,
+        "sink: blocks out of order going round the ring, %u underruns", speaker.stream_underruns());
+
+  std::vector<int16_t> flood(2 * size);
+  size_t room = speaker.available();
+  CHECK(room > 0 && speaker.write(flood.data(), flood.size()) == room && speaker.available() == 0,
+        "sink: a full ring took more than its %zu free samples", room);
+  speaker.end_stream();
+  CHECK(speaker.available() == 0 && !speaker.is_playing(), "sink: still open after end_stream()");
+}
+
+/// @brief play_pcm(): 16-bit and 8-bit samples scaled to CC words at the
+/// requested level, single-ended around half the level or split across a
+/// differential pair
+static void check_pcm_words() {
+  static const int16_t wide[] = {-32768, -16384, 0, 16384, 32767};
+  static const uint8_t narrow[] = {0, 64, 128, 192, 255};
+  static const uint16_t levels[] = {1000, 500};
+  for (uint16_t level : levels) {
+    for (int w = 0; w < 2; w++) {
+      RP2040_Volume speaker(PIN, 255, TONE_ENGINE_NCO);
+      uint32_t carrier = speaker.set_carrier(0);
+      bool played = w ? speaker.play_pcm(wide, 5, 8000, level)
+                      : speaker.play_pcm(narrow, 5, 8000, level);
+      CHECK(played, "pcm: play_pcm() refused");
+      std::vector<uint32_t> samples;
+      run_stream(speaker, carrier, &samples);
+      CHECK(samples.size() >= 6, "pcm: %zu words", samples.size());
+      if (samples.size() < 6) {
+        continue;
+      }
+      uint32_t scale = (uint32_t)level * TOP / 1000;
+      for (int i = 0; i < 5; i++) {
+        int32_t sample = w ? wide[i] : ((int32_t)narrow[i] - 128) << 8;
+        CHECK(samples[i] == pcm_expect(sample, scale), "pcm %d-bit at %u: sample %d gave %u, want %u",
+              w ? 16 : 8, level, sample, samples[i], pcm_expect(sample, scale));
+      }
+      CHECK(samples[5] == 0, "pcm: %u after the last sample, want silence", samples[5]);
+    }
+  }
+
+  // Differential: + (channel A) for the positive half, - (channel B) for the
+  // negative, clamped to the level
+  static const int16_t diff[] = {16384, -16384, -32768, 32767};
+  static const uint32_t diffWant[] = {500, 500u << 16, 1000u << 16, 999};
+  RP2040_Volume speaker(0, 1, TONE_ENGINE_NCO);
+  uint32_t carrier = speaker.set_carrier(0);
+  speaker.play_pcm(diff, 4, 8000);
+  std::vector<uint32_t> samples;
+  run_stream(speaker, carrier, &samples);
+  for (int i = 0; i < 4 && i < (int)samples.size(); i++) {
+    CHECK(samples[i] == diffWant[i], "pcm differential: sample %d gave %08x, want %08x",
+          diff[i], samples[i], diffWant[i]);
+  }
+}
+
+/// @brief set_envelope() on the timer engine: the high half's level follows
+/// attack, decay, sustain and a release that ends inside the note, to within
+/// one period of the tone (the envelope's tick)
+static void check_envelope() {
+  const double attack = 20000, decay = 20000, sustain = 0.5, release = 20000;
+  const uint64_t duration = 100000;
+  const double tick = 1000; // 1 kHz
+  RP2040_Volume speaker(PIN);
+  speaker.set_envelope((uint32_t)attack, (uint32_t)decay, (uint16_t)(sustain * 1000),
+                       (uint32_t)release);
+  speaker.tone_fixed(1000000, 1000, duration);
+  uint64_t start = mock_now();
+  double worst = 0;
+  uint32_t peak = 0, last = 0;
+  while (speaker.is_playing() && mock_step()) {
+    uint32_t cc = pwm_hw->slice[SLICE].cc;
+    if (cc == 0 || !speaker.is_playing()) {
+      continue;
+    }
+    double t = (double)(mock_now() - start);
+    double env = t < attack ? t / attack
+               : t < attack + decay ? 1 - (1 - sustain) * (t - attack) / decay
+               : t < duration - release ? sustain
+               : sustain * (duration - t) / release;
+    worst = fmax(worst, fabs(cc - TOP * env));
+    peak = cc > peak ? cc : peak;
+    last = cc;
+  }
+  // The steepest stage moves TOP / 20 per tick
+  double allowed = TOP * tick / attack + 1;
+  CHECK(worst <= allowed, "envelope: level %.1f off the ADSR shape, allowed %.1f", worst, allowed);
+  CHECK(peak >= TOP - allowed && last <= allowed, "envelope: peaked at %u, ended at %u", peak, last);
+  CHECK(llabs((long long)(mock_now() - start) - (long long)duration) <= 500,
+        "envelope: note lasted %llu us, want %llu", (unsigned long long)(mock_now() - start),
+        (unsigned long long)duration);
+  speaker.clear_envelope();
+}
+
+/// @brief Frequency of a square wave from the spacing of rising edges at
+/// sample indices, averaged over up to periods periods ending at index end
+static double rise_hz(const std::vector<double> &rises, double end, int periods, double rate) {
+  size_t i = 0;
+  while (i + 1 < rises.size() && rises[i + 1] <= end) {
+    i++;
+  }
+  size_t j = i >= (size_t)periods ? i - periods : 0;
+  return i > j ? (i - j) * rate / (rises[i] - rises[j]) : 0;
+}
+
+/// @brief sweep_fixed(), linear and exponential, on the timer and NCO
+/// engines: half way through and at the end the tone is where the curve says
+static void check_sweep_end() {
+  const uint32_t f0 = 200000, f1 = 2000000;
+  const uint64_t duration = 500000;
+  static const uint8_t engines[] = {TONE_ENGINE_TIMER, TONE_ENGINE_NCO};
+  static const uint8_t curves[] = {TONE_SWEEP_LINEAR, TONE_SWEEP_EXPONENTIAL};
+  for (uint8_t engine : engines) {
+    for (uint8_t curve : curves) {
+      RP2040_Volume speaker(PIN, 255, engine);
+      uint32_t carrier = speaker.set_carrier(0);
+      speaker.sweep_fixed(f0, f1, 500, duration, curve);
+      // Rising edge times in us (timer) or samples (NCO)
+      std::vector<double> rises;
+      double rate;
+      if (engine == TONE_ENGINE_TIMER) {
+        uint64_t start = mock_now();
+        uint32_t cc = pwm_hw->slice[SLICE].cc;
+        while (speaker.is_playing() && mock_step()) {
+          if (pwm_hw->slice[SLICE].cc != 0 && cc == 0 && speaker.is_playing()) {
+            rises.push_back((double)(mock_now() - start));
+          }
+          cc = pwm_hw->slice[SLICE].cc;
+        }
+        rate = 1e6;
+      } else {
+        std::vector<uint32_t> samples;
+        run_stream(speaker, carrier, &samples);
+        for (size_t i = 1; i < samples.size(); i++) {
+          if (samples[i] != 0 && samples[i - 1] == 0) {
+            rises.push_back((double)i);
+          }
+        }
+        rate = carrier / 1000.0;
+      }
+      double mid = curve == TONE_SWEEP_LINEAR ? (f0 + f1) / 2000.0 : sqrt((double)f0 * f1) / 1000.0;
+      // Measured over the last few periods either side, so a little behind
+      double atMid = rise_hz(rises, rate * duration / 2e6 + rate * 3 / mid, 6, rate);
+      double atEnd = rise_hz(rises, rate * duration / 1e6, 10, rate);
+      const char *name = curve == TONE_SWEEP_LINEAR ? "linear" : "exponential";
+      CHECK(fabs(atMid - mid) <= mid * 0.03, "%s %s sweep: %.1f Hz half way, want %.1f",
+            engine_name(engine), name, atMid, mid);
+      CHECK(fabs(atEnd - f1 / 1000.0) <= f1 / 1000.0 * 0.03,
+            "%s %s sweep: %.1f Hz at the end, want %.1f", engine_name(engine), name, atEnd,
+            f1 / 1000.0);
+    }
+  }
+}
+
+/// @brief dial() renders each digit's gap as silence inside its note, the
+/// next digit starting right after; dual_tone() has none, and is refused by
+/// the square-wave engines
+static void check_dial_gaps() {
+  const uint32_t toneUs = 40000, gapUs = 20000;
+  RP2040_Volume speaker(PIN, 255, TONE_ENGINE_NCO);
+  uint32_t carrier = speaker.set_carrier(0);
+  double perUs = carrier / 1e9;
+  CHECK(speaker.dial("1 2", 1000, toneUs, gapUs) == 2, "dial: didn't queue two digits");
+  std::vector<uint32_t> samples;
+  run_stream(speaker, carrier, &samples);
+
+  // Runs of at least 16 silent samples, the sine sums only touch 0 briefly
+  std::vector<std::pair<size_t, size_t>> gaps;
+  size_t lastSound = 0;
+  for (size_t i = 0, run = 0; i <= samples.size(); i++) {
+    if (i < samples.size() && samples[i] == 0) {
+      run++;
+      continue;
+    }
+    if (run >= 16) {
+      gaps.push_back(std::make_pair(i - run, run));
+    }
+    if (i < samples.size()) {
+      lastSound = i;
+    }
+    run = 0;
+  }
+  double tone = toneUs * perUs, gap = gapUs * perUs;
+  CHECK(gaps.size() >= 1 && fabs(gaps[0].first - tone) <= 2 && fabs(gaps[0].second - gap) <= 2,
+        "dial: first gap at %zu for %zu samples, want %.0f for %.0f",
+        gaps.empty() ? 0 : gaps[0].first, gaps.empty() ? 0 : gaps[0].second, tone, gap);
+  CHECK(fabs(lastSound + 1 - (2 * tone + gap)) <= 3, "dial: second digit ended at %zu, want %.0f",
+        lastSound + 1, 2 * tone + gap);
+
+  speaker.dual_tone_fixed(697000, 1209000, 1000, toneUs);
+  samples.clear();
+  run_stream(speaker, carrier, &samples);
+  bool gapless = true;
+  for (size_t i = 0, run = 0; i < (size_t)tone && i < samples.size(); i++) {
+    run = samples[i] == 0 ? run + 1 : 0;
+    gapless = gapless && run < 16;
+  }
+  CHECK(gapless && samples.size() >= (size_t)tone, "dual tone: silent stretch inside the note");
+
+  static const uint8_t square[] = {TONE_ENGINE_TIMER, TONE_ENGINE_DMA, TONE_ENGINE_PIO};
+  for (uint8_t engine : square) {
+    RP2040_Volume other(PIN, 255, engine);
+    CHECK(other.dual_tone_fixed(697000, 1209000, 1000, toneUs) == -1,
+          "%s: dual_tone() accepted", engine_name(engine));
+  }
+}
+
+static void retune_half_way(RP2040_Volume &speaker, uint64_t played) {
+  static uint64_t s_half;
+  if (played == 0) {
+    s_half = 0;
+  }
+  if (s_half == 0 && played * 2 >= 6250) { // 50 ms at 62.5 kHz
+    s_half = played;
+    speaker.set_frequency_fixed(1000000);
+  }
+}
+
+/// @brief set_frequency() part way through a note changes the pitch but not
+/// when the note ends
+static void check_set_frequency_end() {
+  const uint64_t duration = 100000;
+  for (int deadline = 0; deadline < 2; deadline++) {
+    RP2040_Volume speaker(PIN);
+    speaker.set_deadline_timing(deadline != 0);
+    speaker.tone_fixed(440000, 500, duration);
+    uint64_t start = mock_now();
+    while (speaker.is_playing() && mock_now() - start < 30000 && mock_step()) {
+    }
+    CHECK(speaker.set_frequency_fixed(1000000), "set_frequency: refused while playing");
+    edge_log log = run_edges(speaker);
+    double half = log.edges >= 2 ? (double)(log.last - log.first) / (log.edges - 1) : 0;
+    int64_t error = (int64_t)(log.end - start) - (int64_t)duration;
+    CHECK(fabs(half - 500) <= 1, "set_frequency: half period %.1f us after, want 500", half);
+    // Counting notes end on an edge of the new pitch, as near as it gets
+    CHECK(deadline ? error == 0 : llabs(error) <= 500,
+          "set_frequency %s: note ended %lld us off", deadline ? "deadline" : "counting",
+          (long long)error);
+  }
+
+  RP2040_Volume speaker(PIN, 255, TONE_ENGINE_NCO);
+  uint32_t carrier = speaker.set_carrier(0);
+  speaker.tone_fixed(440000, 500, duration);
+  std::vector<uint32_t> samples;
+  run_stream(speaker, carrier, &samples, retune_half_way);
+  size_t lastHigh = 0;
+  for (size_t i = 0; i < samples.size(); i++) {
+    lastHigh = samples[i] != 0 ? i : lastHigh;
+  }
+  double end = duration * carrier / 1e9;
+  CHECK(lastHigh < end && end - lastHigh <= carrier / 1e3 / 2000 + 1,
+        "nco set_frequency: last high sample %zu, note ends at %.0f", lastHigh, end);
+}
+
+/// @brief set_idle_timeout(): once quiet the DMA engine gives its channels
+/// back, and the next note claims them again and plays out in full
+static void check_idle_wake() {
+  RP2040_Volume speaker(PIN, 255, TONE_ENGINE_DMA);
+  speaker.set_idle_timeout(5);
+  speaker.tone_fixed(440000, 500, 10000);
+  int ch0 = find_channel(&pwm_hw->slice[SLICE].cc);
+  int ch1 = ch0 >= 0 ? mock_dma_channel((uint)ch0)->config.chain_to : -1;
+  CHECK(ch0 >= 0 && ch1 >= 0, "idle: no channel pair on the slice");
+  if (ch0 < 0 || ch1 < 0) {
+    return;
+  }
+  while (speaker.is_playing() && mock_step()) {
+  }
+  uint64_t quiet = mock_now();
+  CHECK(!speaker.is_asleep(), "idle: asleep straight after the note");
+  mock_advance(5000);
+  CHECK(speaker.is_asleep() && mock_now() - quiet == 5000, "idle: not asleep 5 ms after");
+  CHECK(!mock_dma_channel((uint)ch0)->claimed && !mock_dma_channel((uint)ch1)->claimed,
+        "idle: DMA channels still claimed while asleep");
+
+  speaker.tone_fixed(440000, 500, 10000);
+  uint64_t start = mock_now();
+  int again = find_channel(&pwm_hw->slice[SLICE].cc);
+  CHECK(!speaker.is_asleep() && again >= 0 &&
+        mock_dma_channel((uint)mock_dma_channel((uint)again)->config.chain_to)->claimed,
+        "idle: the next note didn't claim its channels back");
+  while (speaker.is_playing() && mock_step()) {
+  }
+  CHECK(mock_now() - start == 10000, "idle: note after waking lasted %llu us",
+        (unsigned long long)(mock_now() - start));
+  speaker.set_idle_timeout(0);
+}
+
+/// @brief play(patch) plays every step back to back: the patch lasts the
+/// sum of its notes and rests
+static void check_patch_length() {
+  static constexpr tone_request CHIME[] = {
+    tone_patch_note(880000, 800, 120000), tone_patch_rest(40000),
+    tone_patch_sweep(660000, 1320000, 800, 90000), tone_patch_note(1320000, 800, 240000),
+  };
+  static constexpr tone_patch CHIME_PATCH(CHIME, tone_patch_envelope(5000, 0, 1000, 60000));
+  const uint64_t length = 120000 + 40000 + 90000 + 240000;
+  static const uint8_t engines[] = {TONE_ENGINE_TIMER, TONE_ENGINE_DMA, TONE_ENGINE_PIO};
+  for (uint8_t engine : engines) {
+    RP2040_Volume speaker(PIN, 255, engine);
+    speaker.set_deadline_timing(true);
+    CHECK(speaker.play(CHIME_PATCH), "%s: play(patch) refused", engine_name(engine));
+    uint64_t start = mock_now();
+    while (speaker.is_playing() && mock_step()) {
+    }
+    CHECK(mock_now() - start == length, "%s patch: lasted %llu us, want %llu",
+          engine_name(engine), (unsigned long long)(mock_now() - start),
+          (unsigned long long)length);
+  }
+}
+
+// Cores -----------------------------------------------------------------------
+
+static int g_doneCore[2];
+
+/// @brief Done callback recording the core it ran on, user_data is the slot
+static void record_core(void *user_data, bool) {
+  g_doneCore[(intptr_t)user_data] = (int)get_core_num();
+}
+
+/// @brief A stream engine on each core at once: each one's DMA interrupt has
+/// to be taken by its own core
+static void check_dma_cores() {
+  static const uint8_t engines[] = {TONE_ENGINE_NCO, TONE_ENGINE_NCO | TONE_ON_CORE1};
+  for (uint8_t engine1 : engines) {
+    volatile uint32_t *cc[2] = {&pwm_hw->slice[0].cc, &pwm_hw->slice[1].cc};
+    mock_set_core(0);
+    RP2040_Volume speaker0(0, 255, TONE_ENGINE_NCO);
+    mock_set_core(1);
+    RP2040_Volume speaker1(2, 255, engine1);
+    RP2040_Volume *speakers[2] = {&speaker0, &speaker1};
+    int ch[2];
+    for (int core = 0; core < 2; core++) {
+      mock_set_core((uint)core);
+      g_doneCore[core] = -1;
+      speakers[core]->set_done_callback(record_core, (void*)(intptr_t)core);
+      speakers[core]->tone_fixed(440000, 500, 20000);
+      ch[core] = find_channel(cc[core]);
+    }
+    mock_set_core(0);
+    CHECK(mock_irq_enabled(0, DMA_IRQ_1) && !mock_irq_enabled(0, DMA_IRQ_0) &&
+          mock_irq_enabled(1, DMA_IRQ_0) && !mock_irq_enabled(1, DMA_IRQ_1),
+          "dma: each core should have its own DMA IRQ line");
+    for (int block = 0; block < 64 && (speaker0.is_playing() || speaker1.is_playing()); block++) {
+      mock_advance(2000);
+      for (int core = 0; core < 2; core++) {
+        if (ch[core] >= 0 && speakers[core]->is_playing()) {
+          mock_dma_complete((uint)ch[core]);
+          ch[core] = mock_dma_channel((uint)ch[core])->config.chain_to;
+        }
+      }
+    }
+    CHECK(!speaker0.is_playing() && !speaker1.is_playing(), "dma cores: notes didn't finish");
+    CHECK(g_doneCore[0] == 0 && g_doneCore[1] == 1,
+          "dma cores%s: notes ended on cores %d and %d", engine1 & TONE_ON_CORE1 ? " (core1)" : "",
+          g_doneCore[0], g_doneCore[1]);
+    mock_set_core(1);
+    speaker1.set_done_callback(NULL);
+  }
+  mock_set_core(0);
+}
+
+/// @brief Timer engines on both cores at once: each core's edges and note
+/// ends come from its own alarm
+static void check_alarm_cores() {
+  static const uint8_t engines[] = {TONE_ENGINE_TIMER, TONE_ENGINE_TIMER | TONE_ON_CORE1};
+  for (uint8_t engine1 : engines) {
+    mock_set_core(0);
+    RP2040_Volume speaker0(0);
+    mock_set_core(1);
+    RP2040_Volume speaker1(2, 255, engine1);
+    RP2040_Volume *speakers[2] = {&speaker0, &speaker1};
+    RP2040_Tone_Scheduler::reset_stats();
+    uint64_t start = mock_now();
+    for (int core = 0; core < 2; core++) {
+      mock_set_core((uint)core);
+      g_doneCore[core] = -1;
+      speakers[core]->set_deadline_timing(true);
+      speakers[core]->set_done_callback(record_core, (void*)(intptr_t)core);
+      speakers[core]->tone_fixed(core == 0 ? 440000 : 1000000, 500, 50000 + 10000 * core);
+    }
+    mock_set_core(0);
+    uint64_t end[2] = {0, 0};
+    while ((speaker0.is_playing() || speaker1.is_playing()) && mock_step()) {
+      for (int core = 0; core < 2; core++) {
+        if (end[core] == 0 && !speakers[core]->is_playing()) {
+          end[core] = mock_now();
+        }
+      }
+    }
+    CHECK(mock_alarm_core(TONE_ALARM_POOL_HARDWARE_ALARM_NUM) == 0 &&
+          mock_alarm_core(TONE_ALARM_CORE1_HARDWARE_ALARM_NUM) == 1,
+          "alarms: core 0's alarm on core %u, core 1's on core %u",
+          mock_alarm_core(TONE_ALARM_POOL_HARDWARE_ALARM_NUM),
+          mock_alarm_core(TONE_ALARM_CORE1_HARDWARE_ALARM_NUM));
+    CHECK(g_doneCore[0] == 0 && g_doneCore[1] == 1,
+          "alarm cores%s: notes ended on cores %d and %d", engine1 & TONE_ON_CORE1 ? " (core1)" : "",
+          g_doneCore[0], g_doneCore[1]);
+    CHECK(end[0] - start == 50000 && end[1] - start == 60000,
+          "alarm cores: notes lasted %llu and %llu us", (unsigned long long)(end[0] - start),
+          (unsigned long long)(end[1] - start));
+#if TONE_STATS
+    // Each core counts into its own global block, get_stats() adds them up
+    uint32_t total = RP2040_Tone_Scheduler::get_stats().callbacks;
+    uint32_t own = speaker0.get_stats().callbacks + speaker1.get_stats().callbacks;
+    CHECK(total == own && speaker1.get_stats().callbacks != 0,
+          "alarm cores: %u callbacks overall, %u counted by the speakers", total, own);
+#endif
+    mock_set_core(1);
+    speaker1.set_done_callback(NULL);
+  }
+  mock_set_core(0);
+}
+
+static RP2040_Volume *g_core1Speaker;
+
+/// @brief Done callback on core 0 that starts a note on core 1, as if core 1
+/// scheduled while core 0 was servicing its list
+static void start_on_core1(void *, bool) {
+  mock_set_core(1);
+  g_core1Speaker->tone_fixed(1000000, 500, 20);
+  mock_set_core(0);
+}
+
+/// @brief Each core's list has its own lock: core 1 can schedule while core 0
+/// holds its lock in a callback
+static void check_core_locks() {
+  mock_set_core(0);
+  RP2040_Volume speaker0(0);
+  mock_set_core(1);
+  RP2040_Volume speaker1(2);
+  g_core1Speaker = &speaker1;
+  mock_set_core(0);
+  speaker0.set_done_callback(start_on_core1);
+  speaker0.tone_fixed(440000, 500, 10);
+  while (speaker0.is_playing() && mock_step()) {
+  }
+  CHECK(speaker1.is_playing(), "locks: core 1's note didn't start from core 0's callback");
+  while (speaker1.is_playing() && mock_step()) {
+  }
+  CHECK(!speaker1.is_playing(), "locks: core 1's note never ended");
+  speaker0.set_done_callback(NULL);
+}
+
+/// @brief tone_from_isr() goes to the software IRQ of the engine's core, and
+/// gets refused from the other one
+static void check_isr_cores() {
+  for (uint core = 0; core < 2; core++) {
+    mock_set_core(core);
+    RP2040_Volume speaker(PIN);
+    mock_set_core(core ^ 1);
+    CHECK(!speaker.tone_from_isr(440000, 500, 1000), "isr: core %u took a post for core %u",
+          core ^ 1, core);
+    CHECK(!speaker.is_playing(), "isr: core %u played a post from core %u", core, core ^ 1);
+    mock_set_core(core);
+    CHECK(speaker.tone_from_isr(440000, 500, 1000), "isr: core %u refused its own post", core);
+    CHECK(speaker.is_playing(), "isr: core %u's software IRQ didn't run the post", core);
+    speaker.stop_tone();
+  }
+  mock_set_core(0);
+}
+
+// Allocations -----------------------------------------------------------------
+
+static void check_allocations() {
+  {
+    unsigned long before = g_allocs;
+    std::vector<uint32_t> probe(16);
+    CHECK(g_allocs != before, "allocation counting doesn't see std::vector");
+  }
+  static const uint8_t engines[] = {TONE_ENGINE_TIMER, TONE_ENGINE_DMA, TONE_ENGINE_NCO,
+                                    TONE_ENGINE_MIXER, TONE_ENGINE_PIO};
+  for (uint8_t engine : engines) {
+    unsigned long before = g_allocs;
+    uint32_t notes = 0;
+    {
+      RP2040_Volume speaker(PIN, 255, engine);
+      uint32_t carrier = speaker.set_carrier(0);
+      for (int i = 0; i < 4; i++) {
+        speaker.tone_fixed(440000 + 1000 * i, 500, 20000);
+        notes++;
+        if (engine != TONE_ENGINE_MIXER) {
+          for (int q = 0; q < 4; q++) {
+            notes += speaker.enqueue_fixed(880000, 300, 5000) ? 1 : 0;
+          }
+        }
+        if (engine == TONE_ENGINE_NCO || engine == TONE_ENGINE_MIXER) {
+          run_stream(speaker, carrier, NULL);
+        } else {
+          while (speaker.is_playing() && mock_step()) {
+          }
+        }
+      }
+      speaker.stop_tone();
+    }
+    unsigned long allocs = g_allocs - before;
+    printf("%-5s allocations: %lu over %u notes\n", engine_name(engine), allocs, notes);
+    CHECK(allocs == 0, "%s: %lu heap allocations", engine_name(engine), allocs);
+  }
+}
+
+// Cost ------------------------------------------------------------------------
+
+static double since_ns(std::chrono::steady_clock::time_point start) {
+  return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start).count();
+}
+
+static void bench_setup() {
+  printf("instance size:       %zu bytes (host), %zu of them the note queue\n",
+         sizeof(RP2040_Volume), TONE_QUEUE_LENGTH * sizeof(tone_note));
+  static const uint8_t engines[] = {TONE_ENGINE_TIMER, TONE_ENGINE_DMA, TONE_ENGINE_NCO,
+                                    TONE_ENGINE_PIO};
+  const int calls = 20000;
+  for (uint8_t engine : engines) {
+    RP2040_Volume speaker(PIN, 255, engine);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; i++) {
+      speaker.tone_fixed(440000 + (uint32_t)(i & 63), 500, 1000000);
+    }
+    double ns = since_ns(start);
+    speaker.stop_tone();
+    printf("%-5s tone_fixed(): %8.1f ns per call (host)\n", engine_name(engine), ns / calls);
+  }
+}
+
+static void bench_callbacks() {
+  RP2040_Volume speaker(PIN);
+  RP2040_Tone_Scheduler::reset_stats();
+  speaker.tone_fixed(20000000, 500, 2000000);
+  uint32_t steps = 0;
+  auto start = std::chrono::steady_clock::now();
+  while (speaker.is_playing() && mock_step()) {
+    steps++;
+  }
+  double ns = since_ns(start);
+  printf("timer callback:      %8.1f ns per edge, mock included (host, %u edges)\n",
+         ns / steps, steps);
+#if TONE_STATS
+  tone_stats stats = RP2040_Tone_Scheduler::get_stats();
+  CHECK(stats.callbacks == steps, "stats: %u callbacks for %u alarms", stats.callbacks, steps);
+  CHECK(stats.dropped == 0 && stats.lateMaxUs == 0, "stats: %u dropped, %u us late",
+        stats.dropped, stats.lateMaxUs);
+#endif
+}
+
+int main() {
+  check_timer_frequency();
+  check_timer_duration();
+  check_carrier_engine(TONE_ENGINE_DMA);
+  check_carrier_engine(TONE_ENGINE_PIO);
+  check_dma_handoff();
+  check_stream_engine(TONE_ENGINE_NCO, TOP, 2000000);
+  check_stream_engine(TONE_ENGINE_MIXER, TOP, 2000000);
+  check_stream_engine(TONE_ENGINE_NCO, 50, 1000000);
+  check_stream_engine(TONE_ENGINE_MIXER, 50, 1000000);
+  check_sink();
+  check_pcm_words();
+  check_envelope();
+  check_sweep_end();
+  check_dial_gaps();
+  check_set_frequency_end();
+  check_idle_wake();
+  check_patch_length();
+  check_dma_cores();
+  check_alarm_cores();
+  check_core_locks();
+  check_isr_cores();
+  check_allocations();
+  bench_setup();
+  bench_callbacks();
+
+  if (g_failures != 0) {
+    printf("%d checks failed\n", g_failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,4 @@
+#pragma once
+#include "pico.h"
+enum clock_index { clk_sys = 5 };
+uint32_t clock_get_hz(enum clock_index clk_index); // 125 MHz
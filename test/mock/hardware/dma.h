@@ -0,0 +1,48 @@
+#pragma once
+#include "pico.h"
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+typedef struct { uint dreq; int chain_to; bool read_incr, write_incr; uint8_t size, ring_bits; } dma_channel_config;
+typedef struct {
+  volatile uint32_t read_addr, write_addr, transfer_count, ctrl_trig;
+  volatile uint32_t al1_ctrl, al1_read_addr, al1_write_addr, al1_transfer_count_trig;
+  volatile uint32_t al2_ctrl, al2_transfer_count, al2_read_addr, al2_write_addr_trig;
+  volatile uint32_t al3_ctrl, al3_write_addr, al3_transfer_count, al3_read_addr_trig;
+} dma_channel_hw_t;
+typedef struct {
+  dma_channel_hw_t ch[NUM_DMA_CHANNELS];
+  volatile uint32_t intr, inte0, intf0, ints0, _pad, inte1, intf1, ints1;
+  volatile uint32_t abort;
+} dma_hw_t;
+extern dma_hw_t *dma_hw;
+
+int dma_claim_unused_channel(bool required);
+void dma_channel_unclaim(uint channel);
+static inline dma_channel_config dma_channel_get_default_config(uint channel) {
+  dma_channel_config c = {0x3f, (int)channel, true, false, DMA_SIZE_32, 0};
+  return c;
+}
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) { c->size = (uint8_t)size; }
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr) { c->read_incr = incr; }
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr) { c->write_incr = incr; }
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq) { c->dreq = dreq; }
+static inline void channel_config_set_chain_to(dma_channel_config *c, uint chain_to) { c->chain_to = (int)chain_to; }
+static inline void channel_config_set_ring(dma_channel_config *c, bool, uint size_bits) { c->ring_bits = (uint8_t)size_bits; }
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger);
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger);
+void dma_channel_start(uint channel);
+
+int dma_claim_unused_timer(bool required);
+void dma_timer_unclaim(uint timer);
+void dma_timer_set_fraction(uint timer, uint16_t numerator, uint16_t denominator);
+static inline uint dma_get_timer_dreq(uint timer_num) { return 0x3b + timer_num; }
+
+// What the simulation knows about each channel, for the host programs
+typedef struct {
+  bool claimed, started;
+  dma_channel_config config;
+  volatile void *write_addr;
+  const volatile void *read_addr;
+  uint transfer_count;
+} mock_dma_channel_t;
+const mock_dma_channel_t *mock_dma_channel(uint channel);
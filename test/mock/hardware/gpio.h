@@ -0,0 +1,9 @@
+#pragma once
+#include "pico.h"
+enum gpio_function { GPIO_FUNC_PWM = 4, GPIO_FUNC_SIO = 5, GPIO_FUNC_PIO0 = 6,
+                     GPIO_FUNC_PIO1 = 7, GPIO_FUNC_NULL = 0x1f };
+#define GPIO_OUT 1
+#define GPIO_IN 0
+void gpio_set_function(uint gpio, enum gpio_function fn);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
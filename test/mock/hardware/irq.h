@@ -0,0 +1,13 @@
+#pragma once
+#include "pico.h"
+typedef void (*irq_handler_t)(void);
+enum { TIMER_IRQ_0 = 0, DMA_IRQ_0 = 11, DMA_IRQ_1 = 12, FIRST_USER_IRQ = 26 };
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0x80
+#define PICO_DEFAULT_IRQ_PRIORITY 0x80
+#define PICO_LOWEST_IRQ_PRIORITY 0xff
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority);
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool enabled);
+void irq_set_pending(uint num);
+void irq_set_priority(uint num, uint8_t priority);
+int user_irq_claim_unused(bool required);
@@ -0,0 +1,27 @@
+#pragma once
+#include "pico.h"
+typedef struct { volatile uint32_t ctrl, fstat, fdebug, flevel, txf[4], rxf[4]; } pio_hw_t;
+typedef pio_hw_t *PIO;
+extern pio_hw_t mock_pio[2];
+#define pio0 (&mock_pio[0])
+#define pio1 (&mock_pio[1])
+typedef struct pio_program { const uint16_t *instructions; uint8_t length; int8_t origin; } pio_program_t;
+typedef struct { uint wrap_target, wrap, out_base, out_count, set_base, set_count; bool shift_right; uint16_t div_int; uint8_t div_frac; } pio_sm_config;
+enum pio_src_dest { pio_pins = 0 };
+static inline pio_sm_config pio_get_default_sm_config(void) { pio_sm_config c = {}; return c; }
+static inline void sm_config_set_wrap(pio_sm_config *c, uint wrap_target, uint wrap) { c->wrap_target = wrap_target; c->wrap = wrap; }
+static inline void sm_config_set_out_pins(pio_sm_config *c, uint base, uint count) { c->out_base = base; c->out_count = count; }
+static inline void sm_config_set_set_pins(pio_sm_config *c, uint base, uint count) { c->set_base = base; c->set_count = count; }
+static inline void sm_config_set_out_shift(pio_sm_config *c, bool shift_right, bool, uint) { c->shift_right = shift_right; }
+static inline void sm_config_set_clkdiv_int_frac(pio_sm_config *c, uint16_t div_int, uint8_t div_frac) { c->div_int = div_int; c->div_frac = div_frac; }
+static inline uint pio_encode_set(enum pio_src_dest dest, uint value) { return 0xe000 | ((uint)dest << 5) | value; }
+static inline uint pio_get_dreq(PIO pio, uint sm, bool is_tx) { return (pio == pio0 ? 0 : 8) + sm + (is_tx ? 0 : 4); }
+int pio_claim_unused_sm(PIO pio, bool required);
+void pio_sm_unclaim(PIO pio, uint sm);
+bool pio_can_add_program(PIO pio, const pio_program_t *program);
+uint pio_add_program(PIO pio, const pio_program_t *program);
+void pio_gpio_init(PIO pio, uint pin);
+void pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out);
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config);
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+void pio_sm_exec(PIO pio, uint sm, uint instr);
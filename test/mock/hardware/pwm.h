@@ -0,0 +1,24 @@
+#pragma once
+#include "pico.h"
+enum { PWM_CHAN_A = 0, PWM_CHAN_B = 1 };
+typedef struct { bool phase_correct; uint8_t div_int, div_frac; uint16_t top; } pwm_config;
+typedef struct { volatile uint32_t csr, div, ctr, cc, top; } pwm_slice_hw_t;
+typedef struct { pwm_slice_hw_t slice[NUM_PWM_SLICES]; volatile uint32_t en, intr, inte, intf, ints; } pwm_hw_t;
+extern pwm_hw_t *pwm_hw;
+static inline uint pwm_gpio_to_slice_num(uint gpio) { return (gpio >> 1) & 7; }
+static inline uint pwm_gpio_to_channel(uint gpio) { return gpio & 1; }
+static inline uint pwm_get_dreq(uint slice_num) { return 24 + slice_num; }
+static inline pwm_config pwm_get_default_config(void) {
+  pwm_config c = {false, 1, 0, 0xffff};
+  return c;
+}
+static inline void pwm_config_set_phase_correct(pwm_config *c, bool phase_correct) { c->phase_correct = phase_correct; }
+static inline void pwm_config_set_clkdiv_int_frac(pwm_config *c, uint8_t integer, uint8_t fract) {
+  c->div_int = integer;
+  c->div_frac = fract;
+}
+static inline void pwm_config_set_wrap(pwm_config *c, uint16_t wrap) { c->top = wrap; }
+void pwm_init(uint slice_num, pwm_config *c, bool start);
+void pwm_set_enabled(uint slice_num, bool enabled);
+void pwm_set_mask_enabled(uint32_t mask);
+void pwm_set_counter(uint slice_num, uint16_t c);
@@ -0,0 +1,5 @@
+#pragma once
+#include "pico.h"
+typedef struct { volatile uint32_t csr, rvr, cvr, calib; } systick_hw_t;
+extern systick_hw_t mock_systick;
+#define systick_hw (&mock_systick)
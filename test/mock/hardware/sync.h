@@ -0,0 +1,15 @@
+#pragma once
+#include "pico.h"
+typedef volatile uint32_t spin_lock_t;
+int spin_lock_claim_unused(bool required);
+spin_lock_t *spin_lock_instance(uint lock_num);
+// Cores run one at a time here, so finding a lock taken means it would
+// never be released
+static inline uint32_t spin_lock_blocking(spin_lock_t *lock) {
+  if (*lock) {
+    panic("mock: spin lock %p taken twice", (void *)lock);
+  }
+  *lock = 1;
+  return 0;
+}
+static inline void spin_unlock(spin_lock_t *lock, uint32_t) { *lock = 0; }
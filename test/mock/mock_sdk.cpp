@@ -0,0 +1,438 @@
+// Simulated RP2040 for host builds of RP2040_Volume.h: a microsecond clock
+// with the four timer alarms, per-core NVIC state for the IRQs the library
+// uses, DMA channel bookkeeping and plain structs behind pwm_hw/dma_hw. Only
+// what the library touches is modelled; DMA transfers and PWM counters don't
+// run on their own, the host programs step them (mock_dma_complete()).
+#include "pico.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/pio.h"
+#include "hardware/pwm.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "hardware/structs/systick.h"
+#include "pico/multicore.h"
+#include "pico/time.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MOCK_IRQS 32
+#define MOCK_SHARED_HANDLERS 4
+
+static pwm_hw_t s_pwm;
+static dma_hw_t s_dma;
+pwm_hw_t *pwm_hw = &s_pwm;
+dma_hw_t *dma_hw = &s_dma;
+pio_hw_t mock_pio[2];
+systick_hw_t mock_systick;
+
+static uint64_t s_now;
+static uint s_core;       // the core that is running right now
+static uint s_threadCore; // where thread code runs, see mock_set_core()
+static int s_depth;       // interrupt nesting
+
+struct mock_alarm {
+  bool claimed, armed;
+  uint64_t target;
+  uint core;
+  hardware_alarm_callback_t callback;
+};
+static mock_alarm s_alarms[NUM_TIMERS];
+
+struct mock_irq {
+  bool enabled, pending;
+  irq_handler_t exclusive;
+  irq_handler_t shared[MOCK_SHARED_HANDLERS];
+};
+static mock_irq s_irqs[NUM_CORES][MOCK_IRQS];
+static uint32_t s_userIrqsClaimed[NUM_CORES];
+
+static mock_dma_channel_t s_channels[NUM_DMA_CHANNELS];
+static bool s_dmaTimers[4];
+static pwm_config s_slices[NUM_PWM_SLICES];
+static uint s_spinLocks;
+static bool s_sms[2][4];
+static uint s_pioUsed[2];
+
+void panic(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "panic: ");
+  vfprintf(stderr, fmt, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+  abort();
+}
+
+uint get_core_num(void) {
+  return s_core;
+}
+
+void tight_loop_contents(void) {
+  dma_hw->abort = 0; // aborts finish straight away
+}
+
+// Interrupts ------------------------------------------------------------------
+
+static void run_handlers(uint core, uint num) {
+  mock_irq *irq = &s_irqs[core][num];
+  uint saved = s_core;
+  s_core = core;
+  s_depth++;
+  if (irq->exclusive != NULL) {
+    irq->exclusive();
+  }
+  for (int i = 0; i < MOCK_SHARED_HANDLERS; i++) {
+    if (irq->shared[i] != NULL) {
+      irq->shared[i]();
+    }
+  }
+  s_depth--;
+  s_core = saved;
+}
+
+/// @brief Take any pended software IRQs, as the NVIC would once nothing of
+/// higher priority is running
+static void deliver_pending() {
+  if (s_depth != 0) {
+    return;
+  }
+  bool again = true;
+  while (again) {
+    again = false;
+    for (uint core = 0; core < NUM_CORES; core++) {
+      for (uint num = 0; num < MOCK_IRQS; num++) {
+        mock_irq *irq = &s_irqs[core][num];
+        if (irq->pending && irq->enabled) {
+          irq->pending = false;
+          run_handlers(core, num);
+          again = true;
+        }
+      }
+    }
+  }
+}
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t) {
+  mock_irq *irq = &s_irqs[s_core][num];
+  for (int i = 0; i < MOCK_SHARED_HANDLERS; i++) {
+    if (irq->shared[i] == NULL) {
+      irq->shared[i] = handler;
+      return;
+    }
+  }
+  panic("mock: too many shared handlers on IRQ %u", num);
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+  s_irqs[s_core][num].exclusive = handler;
+}
+
+void irq_set_enabled(uint num, bool enabled) {
+  s_irqs[s_core][num].enabled = enabled;
+  if (enabled) {
+    deliver_pending();
+  }
+}
+
+void irq_set_pending(uint num) {
+  s_irqs[s_core][num].pending = true;
+  deliver_pending();
+}
+
+void irq_set_priority(uint, uint8_t) {}
+
+bool mock_irq_enabled(uint core, uint num) {
+  return s_irqs[core][num].enabled;
+}
+
+int user_irq_claim_unused(bool required) {
+  for (uint num = MOCK_IRQS - 1; num >= FIRST_USER_IRQ; num--) {
+    if ((s_userIrqsClaimed[s_core] & (1u << num)) == 0) {
+      s_userIrqsClaimed[s_core] |= 1u << num;
+      return (int)num;
+    }
+  }
+  if (required) {
+    panic("mock: no user IRQs left");
+  }
+  return -1;
+}
+
+// Time and alarms -------------------------------------------------------------
+
+uint64_t time_us_64(void) {
+  return s_now;
+}
+
+uint32_t time_us_32(void) {
+  return (uint32_t)s_now;
+}
+
+uint64_t mock_now(void) {
+  return s_now;
+}
+
+void mock_set_core(uint core) {
+  s_threadCore = core;
+  s_core = core;
+}
+
+void hardware_alarm_claim(uint alarm_num) {
+  if (s_alarms[alarm_num].claimed) {
+    panic("mock: hardware alarm %u already claimed", alarm_num);
+  }
+  s_alarms[alarm_num].claimed = true;
+}
+
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback) {
+  // The SDK enables the alarm's IRQ on the calling core
+  s_alarms[alarm_num].callback = callback;
+  s_alarms[alarm_num].core = s_core;
+}
+
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t) {
+  mock_alarm *alarm = &s_alarms[alarm_num];
+  if (t._private_us_since_boot <= s_now) {
+    alarm->armed = false;
+    return true; // missed
+  }
+  alarm->target = t._private_us_since_boot;
+  alarm->armed = true;
+  return false;
+}
+
+uint mock_alarm_core(uint alarm_num) {
+  return s_alarms[alarm_num].core;
+}
+
+static mock_alarm *next_alarm() {
+  mock_alarm *next = NULL;
+  for (int i = 0; i < NUM_TIMERS; i++) {
+    if (s_alarms[i].armed && (next == NULL || s_alarms[i].target < next->target)) {
+      next = &s_alarms[i];
+    }
+  }
+  return next;
+}
+
+static void fire(mock_alarm *alarm) {
+  if (alarm->target > s_now) {
+    s_now = alarm->target;
+  }
+  alarm->armed = false;
+  uint saved = s_core;
+  s_core = alarm->core;
+  s_depth++;
+  alarm->callback((uint)(alarm - s_alarms));
+  s_depth--;
+  s_core = saved;
+  deliver_pending();
+}
+
+bool mock_step(void) {
+  mock_alarm *alarm = next_alarm();
+  if (alarm == NULL) {
+    return false;
+  }
+  fire(alarm);
+  return true;
+}
+
+void mock_advance(uint64_t us) {
+  uint64_t end = s_now + us;
+  mock_alarm *alarm;
+  while ((alarm = next_alarm()) != NULL && alarm->target <= end) {
+    fire(alarm);
+  }
+  s_now = end;
+}
+
+// Locks and clocks ------------------------------------------------------------
+
+int spin_lock_claim_unused(bool) {
+  return (int)(16 + s_spinLocks++);
+}
+
+spin_lock_t *spin_lock_instance(uint lock_num) {
+  static spin_lock_t s_locks[32];
+  return &s_locks[lock_num];
+}
+
+uint32_t clock_get_hz(enum clock_index) {
+  return 125000000;
+}
+
+void multicore_launch_core1(void (*)(void)) {
+  panic("mock: core 1 is not simulated");
+}
+
+// GPIO and PWM ----------------------------------------------------------------
+
+void gpio_set_function(uint, enum gpio_function) {}
+void gpio_set_dir(uint, bool) {}
+void gpio_put(uint, bool) {}
+
+void pwm_init(uint slice_num, pwm_config *c, bool start) {
+  s_slices[slice_num] = *c;
+  pwm_hw->slice[slice_num].top = c->top;
+  pwm_set_enabled(slice_num, start);
+}
+
+void pwm_set_enabled(uint slice_num, bool enabled) {
+  if (enabled) {
+    pwm_hw->en |= 1u << slice_num;
+  } else {
+    pwm_hw->en &= ~(1u << slice_num);
+  }
+}
+
+void pwm_set_mask_enabled(uint32_t mask) {
+  pwm_hw->en = mask;
+}
+
+void pwm_set_counter(uint slice_num, uint16_t c) {
+  pwm_hw->slice[slice_num].ctr = c;
+}
+
+uint32_t mock_pwm_carrier_mhz(uint slice) {
+  const pwm_config &c = s_slices[slice];
+  uint64_t div16 = (uint64_t)c.div_int * 16 + c.div_frac;
+  uint64_t cycles = ((uint64_t)c.top + 1) * (c.phase_correct ? 2 : 1) * div16;
+  return (uint32_t)((uint64_t)clock_get_hz(clk_sys) * 16000 / cycles);
+}
+
+// DMA -------------------------------------------------------------------------
+
+int dma_claim_unused_channel(bool required) {
+  for (uint ch = 0; ch < NUM_DMA_CHANNELS; ch++) {
+    if (!s_channels[ch].claimed) {
+      s_channels[ch] = mock_dma_channel_t();
+      s_channels[ch].claimed = true;
+      return (int)ch;
+    }
+  }
+  if (required) {
+    panic("mock: no DMA channels left");
+  }
+  return -1;
+}
+
+void dma_channel_unclaim(uint channel) {
+  s_channels[channel].claimed = false;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {
+  mock_dma_channel_t *ch = &s_channels[channel];
+  ch->config = *config;
+  ch->write_addr = write_addr;
+  ch->read_addr = read_addr;
+  ch->transfer_count = transfer_count;
+  dma_hw->ch[channel].transfer_count = transfer_count;
+  ch->started = trigger;
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger) {
+  s_channels[channel].read_addr = read_addr;
+  if (trigger) {
+    s_channels[channel].started = true;
+  }
+}
+
+void dma_channel_start(uint channel) {
+  s_channels[channel].started = true;
+}
+
+const mock_dma_channel_t *mock_dma_channel(uint channel) {
+  s_channels[channel].transfer_count = dma_hw->ch[channel].transfer_count;
+  return &s_channels[channel];
+}
+
+void mock_dma_complete(uint channel) {
+  // The library acks by writing ints0/ints1, which clears on the chip but
+  // just stores here, so only the channel completing now is left pending
+  uint32_t bit = 1u << channel;
+  dma_hw->ints0 = 0;
+  dma_hw->ints1 = 0;
+  if (dma_hw->inte0 & bit) {
+    dma_hw->ints0 = bit;
+    for (uint core = 0; core < NUM_CORES; core++) {
+      if (s_irqs[core][DMA_IRQ_0].enabled) {
+        run_handlers(core, DMA_IRQ_0);
+      }
+    }
+    dma_hw->ints0 = 0;
+  }
+  if (dma_hw->inte1 & bit) {
+    dma_hw->ints1 = bit;
+    for (uint core = 0; core < NUM_CORES; core++) {
+      if (s_irqs[core][DMA_IRQ_1].enabled) {
+        run_handlers(core, DMA_IRQ_1);
+      }
+    }
+    dma_hw->ints1 = 0;
+  }
+  deliver_pending();
+}
+
+int dma_claim_unused_timer(bool required) {
+  for (uint t = 0; t < 4; t++) {
+    if (!s_dmaTimers[t]) {
+      s_dmaTimers[t] = true;
+      return (int)t;
+    }
+  }
+  if (required) {
+    panic("mock: no DMA timers left");
+  }
+  return -1;
+}
+
+void dma_timer_unclaim(uint timer) {
+  s_dmaTimers[timer] = false;
+}
+
+void dma_timer_set_fraction(uint, uint16_t, uint16_t) {}
+
+// PIO -------------------------------------------------------------------------
+
+static int pio_index(PIO pio) {
+  return pio == pio0 ? 0 : 1;
+}
+
+int pio_claim_unused_sm(PIO pio, bool required) {
+  for (int sm = 0; sm < 4; sm++) {
+    if (!s_sms[pio_index(pio)][sm]) {
+      s_sms[pio_index(pio)][sm] = true;
+      return sm;
+    }
+  }
+  if (required) {
+    panic("mock: no state machines left");
+  }
+  return -1;
+}
+
+void pio_sm_unclaim(PIO pio, uint sm) {
+  s_sms[pio_index(pio)][sm] = false;
+}
+
+bool pio_can_add_program(PIO pio, const pio_program_t *program) {
+  return s_pioUsed[pio_index(pio)] + program->length <= 32;
+}
+
+uint pio_add_program(PIO pio, const pio_program_t *program) {
+  uint offset = s_pioUsed[pio_index(pio)];
+  s_pioUsed[pio_index(pio)] += program->length;
+  return offset;
+}
+
+void pio_gpio_init(PIO, uint) {}
+void pio_sm_set_consecutive_pindirs(PIO, uint, uint, uint, bool) {}
+void pio_sm_init(PIO, uint, uint, const pio_sm_config *) {}
+void pio_sm_set_enabled(PIO, uint, bool) {}
+void pio_sm_exec(PIO, uint, uint) {}
@@ -0,0 +1,44 @@
+// Host stand-in for the Pico SDK's base header: the types, attributes and
+// core intrinsics RP2040_Volume.h relies on, plus the control surface the
+// host programs use to drive the simulated hardware (mock_sdk.cpp).
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+typedef unsigned int uint;
+
+#define __not_in_flash_func(f) f
+#define __time_critical_func(f) f
+#define __force_inline inline
+
+#define NUM_CORES 2
+#define NUM_DMA_CHANNELS 12
+#define NUM_PWM_SLICES 8
+#define NUM_BANK0_GPIOS 30
+#define NUM_TIMERS 4
+
+// Core intrinsics: one thread of execution, so interrupts and events are
+// only ever taken where the simulation delivers them
+static inline void __wfe(void) {}
+static inline void __sev(void) {}
+static inline void __dmb(void) {}
+static inline uint32_t save_and_disable_interrupts(void) { return 0; }
+static inline void restore_interrupts(uint32_t) {}
+static inline void hw_set_bits(volatile uint32_t *addr, uint32_t mask) { *addr |= mask; }
+static inline void hw_clear_bits(volatile uint32_t *addr, uint32_t mask) { *addr &= ~mask; }
+
+uint get_core_num(void);
+void panic(const char *fmt, ...);
+void tight_loop_contents(void); // finishes any DMA abort, see dma_hw->abort
+
+// Simulation control, see mock_sdk.cpp
+void mock_set_core(uint core);
+uint64_t mock_now(void);
+void mock_advance(uint64_t us);       // move time on, running alarms due on the way
+bool mock_step(void);                 // run to the next alarm and fire it
+uint mock_alarm_core(uint alarm_num); // core that took the alarm's IRQ
+bool mock_irq_enabled(uint core, uint num);
+void mock_dma_complete(uint channel); // raise a channel's completion IRQ
+uint32_t mock_pwm_carrier_mhz(uint slice); // slice wrap rate, milli-Hertz
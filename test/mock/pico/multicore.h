@@ -0,0 +1,3 @@
+#pragma once
+#include "pico.h"
+void multicore_launch_core1(void (*entry)(void)); // not simulated
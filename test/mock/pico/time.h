@@ -0,0 +1,10 @@
+#pragma once
+#include "pico.h"
+typedef struct { uint64_t _private_us_since_boot; } absolute_time_t;
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+static inline absolute_time_t from_us_since_boot(uint64_t us) {
+  absolute_time_t t;
+  t._private_us_since_boot = us;
+  return t;
+}